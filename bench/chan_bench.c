@@ -0,0 +1,175 @@
+/*
+* rsp_tcp - filter bank channelizer benchmark
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Input rate dsp_channelize() sustains per core for 8 to 1024 channels,
+ * at the channel spacing (step = channels) and at twice it (step =
+ * channels / 2), with every channel selected. Each call does the rows of
+ * one CHAN_CHUNK of input, shared out over the threads in runs of
+ * consecutive rows like chan_run() does, once on one thread and once on
+ * all of them. Multiply by the channel count for channels x sample rate.
+ *
+ *   chan_bench [threads, 0 for one per processor] [seconds per case]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "rsp_tcp_convert.h"
+#include "rsp_tcp_chan.h"
+
+static unsigned int threads = 0;
+static double seconds = 0.5;
+
+static dsp_channelizer_t channelizer;
+static unsigned int bins[DSP_MAX_CHANNELS];
+static unsigned int rows;
+
+static float xi[DSP_MAX_CHANNELS * DSP_CHANNEL_TAPS + CHAN_CHUNK];
+static float xq[DSP_MAX_CHANNELS * DSP_CHANNEL_TAPS + CHAN_CHUNK];
+static short yi[CHAN_MAX_OUTPUT], yq[CHAN_MAX_OUTPUT];
+
+// the threads of the running case meet here before and after every call
+static pthread_barrier_t start_barrier, done_barrier;
+static unsigned int parts;
+static volatile int stop;
+
+static void run_part(unsigned int i)
+{
+	unsigned int first = rows * i / parts;
+	unsigned int last = rows * (i + 1) / parts;
+	unsigned int n = channelizer.channels;
+
+	dsp_channelize(&channelizer, xi + first * channelizer.step, xq + first * channelizer.step, last - first,
+		(1 + first * channelizer.step) & (n - 1), bins, n, yi + first * n, yq + first * n);
+}
+
+static void *worker(void *arg)
+{
+	unsigned int i = (unsigned int)(size_t)arg;
+
+	while (1) {
+		pthread_barrier_wait(&start_barrier);
+		if (stop) {
+			break;
+		}
+		run_part(i);
+		pthread_barrier_wait(&done_barrier);
+	}
+
+	return NULL;
+}
+
+static double now_s(void)
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+// input MS/s per core of one channel count, step and thread count
+static double run(unsigned int channels, unsigned int step, unsigned int count)
+{
+	pthread_t thread[CHAN_MAX_THREADS];
+	unsigned long long in = 0;
+	unsigned int i, c;
+	double t0, t;
+
+	if (dsp_channelizer_init(&channelizer, channels, step) != 0) {
+		return 0;
+	}
+	for (c = 0; c < channels; c++) {
+		bins[c] = c ^ (channels / 2);
+	}
+	rows = CHAN_CHUNK / step;
+
+	parts = count;
+	stop = 0;
+	pthread_barrier_init(&start_barrier, NULL, count);
+	pthread_barrier_init(&done_barrier, NULL, count);
+	for (i = 1; i < count; i++) {
+		pthread_create(&thread[i], NULL, worker, (void *)(size_t)i);
+	}
+
+	t0 = now_s();
+	do {
+		if (count > 1) {
+			pthread_barrier_wait(&start_barrier);
+			run_part(0);
+			pthread_barrier_wait(&done_barrier);
+		}
+		else {
+			run_part(0);
+		}
+		in += (unsigned long long)rows * step;
+	} while ((t = now_s() - t0) < seconds);
+
+	stop = 1;
+	if (count > 1) {
+		pthread_barrier_wait(&start_barrier);
+	}
+	for (i = 1; i < count; i++) {
+		pthread_join(thread[i], NULL);
+	}
+	pthread_barrier_destroy(&start_barrier);
+	pthread_barrier_destroy(&done_barrier);
+	dsp_channelizer_free(&channelizer);
+
+	return in / t / 1e6 / count;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int channels, i;
+	long online = sysconf(_SC_NPROCESSORS_ONLN);
+
+	if (argc > 1) threads = (unsigned int)atoi(argv[1]);
+	if (argc > 2) seconds = atof(argv[2]);
+
+	if (threads == 0) {
+		threads = online > 0 ? (unsigned int)online : 1;
+	}
+	if (threads > CHAN_MAX_THREADS || seconds <= 0) {
+		printf("usage: chan_bench [threads, up to %d] [seconds per case]\n", CHAN_MAX_THREADS);
+		return 1;
+	}
+
+	convert_init();
+	fft_setup();
+	dsp_init();
+
+	srand(1);
+	for (i = 0; i < sizeof(xi) / sizeof(xi[0]); i++) {
+		xi[i] = (float)(rand() % 8192 - 4096);
+		xq[i] = (float)(rand() % 8192 - 4096);
+	}
+
+	printf("%s kernels, input MS/s per core, every channel selected\n", convert_name());
+	printf("%-8s %10s %10s %10s %10s\n", "step", "n", "n", "n/2", "n/2");
+	printf("%-8s %10u %10u %10u %10u\n", "threads", 1, threads, 1, threads);
+	for (channels = 8; channels <= DSP_MAX_CHANNELS; channels *= 2) {
+		printf("%-8u %10.1f %10.1f %10.1f %10.1f\n", channels,
+			run(channels, channels, 1), run(channels, channels, threads),
+			run(channels, channels / 2, 1), run(channels, channels / 2, threads));
+	}
+
+	return 0;
+}
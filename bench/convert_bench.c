@@ -0,0 +1,178 @@
+/*
+* rsp_tcp - conversion kernel benchmark
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Bytes per cycle of the conversion kernels, scalar and every vector set
+ * the build and the CPU have, counted on the int16 I/Q input (4 bytes per
+ * sample). The 8-bit kernels run at the default shift of 2, next to
+ * "uint8 trunc", the truncating loop they replaced, which is the same on
+ * every row. "int16 copy" is the whole INT16 path, the copy the callback makes
+ * into the raw block and the interleave of the conversion thread into the
+ * frame, against "int16", the interleave alone.
+ *
+ * Cycles are TSC ticks on x86. Elsewhere the figure is bytes per ns.
+ *
+ *   convert_bench [samples per call] [calls]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "rsp_tcp_convert.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_UNIT "B/cycle"
+static unsigned long long ticks(void)
+{
+	return __rdtsc();
+}
+#else
+#define BENCH_UNIT "B/ns"
+static unsigned long long ticks(void)
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (unsigned long long)t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+#endif
+
+static unsigned int samples = 2048;
+static unsigned int calls = 20000;
+
+static short *xi, *xq;
+static short *raw_i, *raw_q;
+static char *out;
+
+static const struct {
+	convert_isa_t isa;
+	const char *name;
+} isas[] = {
+	{ CONVERT_ISA_SCALAR, "scalar" },
+	{ CONVERT_ISA_SSE2, "sse2" },
+	{ CONVERT_ISA_AVX2, "avx2" },
+	{ CONVERT_ISA_NEON, "neon" }
+};
+
+static const struct {
+	rsp_tcp_sample_format_t format;
+	int shift;
+	int dither;
+	const char *name;
+} kernels[] = {
+	{ RSP_TCP_SAMPLE_FORMAT_UINT8, 2, 0, "uint8" },
+	{ RSP_TCP_SAMPLE_FORMAT_UINT8, 2, 1, "uint8 dither" },
+	{ RSP_TCP_SAMPLE_FORMAT_INT16, 0, 0, "int16" },
+	{ RSP_TCP_SAMPLE_FORMAT_FLOAT32, 0, 0, "float32" },
+	{ RSP_TCP_SAMPLE_FORMAT_PACKED12, 0, 0, "packed12" },
+	{ RSP_TCP_SAMPLE_FORMAT_BFP8, 0, 0, "bfp8" },
+	{ RSP_TCP_SAMPLE_FORMAT_BFP6, 0, 0, "bfp6" }
+};
+
+// the 8-bit conversion before rounding and saturation, at shift 2
+static void uint8_truncate(char *dst, const short *xi, const short *xq, unsigned int n)
+{
+	unsigned char *o = (unsigned char *)dst;
+	unsigned int i;
+
+	for (i = 0; i < n; i++) {
+		*(o++) = (unsigned char)(((xi[i] << 2) >> 8) + 128);
+		*(o++) = (unsigned char)(((xq[i] << 2) >> 8) + 128);
+	}
+}
+
+// input bytes per tick of one kernel, best of three rounds
+static double measure(convert_fn fn, int copy)
+{
+	unsigned long long t0, t, best = 0;
+	unsigned int round, i;
+
+	for (round = 0; round < 3; round++) {
+		t0 = ticks();
+		for (i = 0; i < calls; i++) {
+			if (copy) {
+				memcpy(raw_i, xi, samples * sizeof(short));
+				memcpy(raw_q, xq, samples * sizeof(short));
+				fn(out, raw_i, raw_q, samples);
+			}
+			else {
+				fn(out, xi, xq, samples);
+			}
+		}
+		t = ticks() - t0;
+		if (best == 0 || t < best) {
+			best = t;
+		}
+	}
+
+	return (double)samples * 2 * sizeof(short) * calls / best;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int i, k, f;
+
+	if (argc > 1) samples = (unsigned int)atoi(argv[1]);
+	if (argc > 2) calls = (unsigned int)atoi(argv[2]);
+
+	// whole groups of every format
+	samples -= samples % RSP_TCP_BFP_BLOCK_SAMPLES;
+	if (samples == 0 || calls == 0) {
+		printf("usage: convert_bench [samples per call, from %d] [calls]\n", RSP_TCP_BFP_BLOCK_SAMPLES);
+		return 1;
+	}
+
+	xi = (short *)malloc(samples * sizeof(short));
+	xq = (short *)malloc(samples * sizeof(short));
+	raw_i = (short *)malloc(samples * sizeof(short));
+	raw_q = (short *)malloc(samples * sizeof(short));
+	out = (char *)malloc(samples * 8);
+	if (xi == NULL || xq == NULL || raw_i == NULL || raw_q == NULL || out == NULL) {
+		printf("out of memory\n");
+		return 1;
+	}
+
+	srand(1);
+	for (i = 0; i < samples; i++) {
+		xi[i] = (short)(rand() % 8192 - 4096);
+		xq[i] = (short)(rand() % 8192 - 4096);
+	}
+
+	printf("%u samples per call, %u calls, input " BENCH_UNIT "\n%-8s", samples, calls, "");
+	for (f = 0; f < sizeof(kernels) / sizeof(kernels[0]); f++) {
+		printf(" %12s", kernels[f].name);
+	}
+	printf(" %12s %12s\n", "uint8 trunc", "int16 copy");
+
+	for (k = 0; k < sizeof(isas) / sizeof(isas[0]); k++) {
+		if (convert_use(isas[k].isa) != 0) {
+			continue;
+		}
+
+		printf("%-8s", isas[k].name);
+		for (f = 0; f < sizeof(kernels) / sizeof(kernels[0]); f++) {
+			printf(" %12.2f", measure(convert_select(kernels[f].format, kernels[f].shift, kernels[f].dither), 0));
+		}
+		printf(" %12.2f", measure(uint8_truncate, 0));
+		printf(" %12.2f\n", measure(convert_select(RSP_TCP_SAMPLE_FORMAT_INT16, 0, 0), 1));
+	}
+
+	return 0;
+}
@@ -0,0 +1,213 @@
+/*
+* rsp_tcp - conversion kernel check
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Checks that every vector kernel set the build and the CPU have writes
+ * exactly the bytes of the scalar reference, for every format, every 8-bit
+ * shift with and without dither, and run lengths around the vector widths,
+ * and the same peak and power the automatic 8-bit scaling reads.
+ * The input mixes random samples with the edge values the saturation and
+ * rounding paths care about. Exits with 1 on the first difference.
+ *
+ *   convert_check
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rsp_tcp_convert.h"
+
+#define CHECK_SAMPLES 4096
+
+static short xi[CHECK_SAMPLES], xq[CHECK_SAMPLES];
+
+// big enough for any format, float32 takes the most
+static char ref[CHECK_SAMPLES * 8 + 64];
+static char out[CHECK_SAMPLES * 8 + 64];
+
+static const short edges[] = {
+	0, 1, -1, 2, -2, 127, -128, 128, -129, 255, -256, 4095, -4096, 8191, -8192,
+	16383, -16384, 32766, -32767, 32767, -32768
+};
+
+static const rsp_tcp_sample_format_t formats[] = {
+	RSP_TCP_SAMPLE_FORMAT_UINT8,
+	RSP_TCP_SAMPLE_FORMAT_INT16,
+	RSP_TCP_SAMPLE_FORMAT_FLOAT32,
+	RSP_TCP_SAMPLE_FORMAT_PACKED10,
+	RSP_TCP_SAMPLE_FORMAT_PACKED12,
+	RSP_TCP_SAMPLE_FORMAT_PACKED14,
+	RSP_TCP_SAMPLE_FORMAT_BFP8,
+	RSP_TCP_SAMPLE_FORMAT_BFP6
+};
+
+static const struct {
+	convert_isa_t isa;
+	const char *name;
+} isas[] = {
+	{ CONVERT_ISA_SSE2, "sse2" },
+	{ CONVERT_ISA_AVX2, "avx2" },
+	{ CONVERT_ISA_NEON, "neon" }
+};
+
+static void fill_input(unsigned int seed)
+{
+	unsigned int i, e = sizeof(edges) / sizeof(edges[0]);
+
+	srand(seed);
+	for (i = 0; i < CHECK_SAMPLES; i++) {
+		// runs of edge values, of full scale noise and of small signals in turn
+		switch ((i / 64) % 3) {
+		case 0:
+			xi[i] = edges[rand() % e];
+			xq[i] = edges[rand() % e];
+			break;
+		case 1:
+			xi[i] = (short)(rand() & 0xffff);
+			xq[i] = (short)(rand() & 0xffff);
+			break;
+		default:
+			xi[i] = (short)(rand() % 512 - 256);
+			xq[i] = (short)(rand() % 512 - 256);
+			break;
+		}
+	}
+}
+
+// output of n samples with the kernel set isa, from fresh dither lanes
+static unsigned int run(char *dst, convert_isa_t isa, rsp_tcp_sample_format_t format, int shift, int dither, unsigned int n)
+{
+	unsigned int bytes = n / convert_group_samples(format) * convert_group_bytes(format);
+
+	convert_use(isa);
+	memset(dst, 0xa5, bytes + 64);
+	convert_select(format, shift, dither)(dst, xi, xq, n);
+
+	return bytes;
+}
+
+static int check(const char *name, convert_isa_t isa, rsp_tcp_sample_format_t format, int shift, int dither, unsigned int n)
+{
+	unsigned int bytes, i;
+
+	bytes = run(ref, CONVERT_ISA_SCALAR, format, shift, dither, n);
+	run(out, isa, format, shift, dither, n);
+
+	// the bytes behind the output must stay untouched as well
+	if (memcmp(ref, out, bytes + 64) == 0) {
+		return 0;
+	}
+
+	for (i = 0; ref[i] == out[i]; i++) {
+	}
+	printf("%s: format %d shift %d dither %d, %u samples: byte %u of %u is %02x, scalar %02x\n",
+		name, format, shift, dither, n, i, bytes, (unsigned char)out[i], (unsigned char)ref[i]);
+
+	return 1;
+}
+
+// the level scans of the automatic 8-bit scaling
+static int check_level(const char *name, convert_isa_t isa, unsigned int n)
+{
+	unsigned long long ref_power, power;
+	int ref_bits, bits;
+
+	convert_use(CONVERT_ISA_SCALAR);
+	ref_bits = convert_peak_bits(xi, xq, n);
+	ref_power = convert_power(xi, xq, n);
+	convert_use(isa);
+	bits = convert_peak_bits(xi, xq, n);
+	power = convert_power(xi, xq, n);
+
+	if (bits != ref_bits || power != ref_power) {
+		printf("%s: %u samples: peak %d bits, power %llu, scalar %d bits, %llu\n", name, n, bits, power, ref_bits, ref_power);
+		return 1;
+	}
+
+	return 0;
+}
+
+// every format and shift for runs of n samples, n rounded down to whole groups
+static int check_run(const char *name, convert_isa_t isa, unsigned int n)
+{
+	unsigned int f, group;
+	int shift, dither;
+
+	if (check_level(name, isa, n)) {
+		return 1;
+	}
+
+	for (f = 0; f < sizeof(formats) / sizeof(formats[0]); f++) {
+		group = convert_group_samples(formats[f]);
+		if (n < group) {
+			continue;
+		}
+
+		if (formats[f] != RSP_TCP_SAMPLE_FORMAT_UINT8) {
+			if (check(name, isa, formats[f], 0, 0, n / group * group)) {
+				return 1;
+			}
+			continue;
+		}
+
+		for (shift = 0; shift <= CONVERT_MAX_SHIFT; shift++) {
+			for (dither = 0; dither <= 1; dither++) {
+				if (check(name, isa, formats[f], shift, dither, n)) {
+					return 1;
+				}
+			}
+		}
+	}
+
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int k, n, seed;
+	int checked = 0;
+
+	for (k = 0; k < sizeof(isas) / sizeof(isas[0]); k++) {
+		if (convert_use(isas[k].isa) != 0) {
+			continue;
+		}
+		checked++;
+
+		for (seed = 1; seed <= 4; seed++) {
+			fill_input(seed);
+
+			// every length up to a few vectors of the widest group, then a whole buffer
+			for (n = 1; n <= 4 * RSP_TCP_BFP_BLOCK_SAMPLES; n++) {
+				if (check_run(isas[k].name, isas[k].isa, n)) {
+					return 1;
+				}
+			}
+			if (check_run(isas[k].name, isas[k].isa, CHECK_SAMPLES)) {
+				return 1;
+			}
+		}
+
+		printf("%s: identical to scalar\n", isas[k].name);
+	}
+
+	if (!checked) {
+		printf("no vector kernels in this build or on this CPU, nothing to check\n");
+	}
+
+	return 0;
+}
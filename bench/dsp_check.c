@@ -0,0 +1,277 @@
+/*
+* rsp_tcp - signal processing kernel check
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Checks that every vector kernel set the build and the CPU have gives
+ * exactly the output of the scalar reference for the decimator chains
+ * (half-bands, FIR, resampler), the down-converter, the channelizer and the
+ * FFT. The decimators get their input in runs of varying length so the
+ * kernel tails are covered as well. Exits with 1 on the first difference.
+ *
+ *   dsp_check
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rsp_tcp_convert.h"
+#include "rsp_tcp_dsp.h"
+
+#define CHECK_SAMPLES 16384
+#define CHECK_ROWS 8
+
+static short xi[CHECK_SAMPLES], xq[CHECK_SAMPLES];
+static short ref_i[CHECK_SAMPLES], ref_q[CHECK_SAMPLES];
+static short out_i[CHECK_SAMPLES], out_q[CHECK_SAMPLES];
+
+// input of the channelizer rows and of the largest FFT
+#define CHECK_FLOATS (FFT_MAX_SIZE > DSP_MAX_CHANNELS * (DSP_CHANNEL_TAPS + CHECK_ROWS) ? \
+	FFT_MAX_SIZE : DSP_MAX_CHANNELS * (DSP_CHANNEL_TAPS + CHECK_ROWS))
+
+static float fxi[CHECK_FLOATS];
+static float fxq[CHECK_FLOATS];
+
+static float ref_re[FFT_MAX_SIZE], ref_im[FFT_MAX_SIZE];
+static float out_re[FFT_MAX_SIZE], out_im[FFT_MAX_SIZE];
+static float work[2 * FFT_MAX_SIZE];
+
+static dsp_decimator_t decimator;
+static dsp_channelizer_t channelizer;
+
+static const struct {
+	convert_isa_t isa;
+	const char *name;
+} isas[] = {
+	{ CONVERT_ISA_SSE2, "sse2" },
+	{ CONVERT_ISA_AVX2, "avx2" },
+	{ CONVERT_ISA_NEON, "neon" }
+};
+
+// software factor and resampler rates, or a down-converter when offset or ddc_rate is set
+static const struct {
+	unsigned int factor;
+	unsigned int in_rate, out_rate;
+	int offset;
+	unsigned int ddc_rate;
+} chains[] = {
+	{ 2, 0, 0, 0, 0 },
+	{ 3, 0, 0, 0, 0 },
+	{ 24, 0, 0, 0, 0 },
+	{ 1 << 10, 0, 0, 0, 0 },
+	{ 1, 2048000, 2000000, 0, 0 },
+	{ 1, 10000000, 8000000, 0, 0 },
+	{ 2, 8000000, 6144000, 0, 0 },
+	{ 0, 2000000, 0, 300000, 200000 },
+	{ 0, 2000000, 0, -612345, 192000 },
+	{ 0, 10000000, 0, 1000, 12000 }
+};
+
+// runs of edge values, of full scale noise and of small signals in turn
+static void fill_input(unsigned int seed)
+{
+	static const short edges[] = { 0, 1, -1, 32767, -32768, 16384, -16384 };
+	unsigned int i;
+
+	srand(seed);
+	for (i = 0; i < CHECK_SAMPLES; i++) {
+		switch ((i / 256) % 3) {
+		case 0:
+			xi[i] = edges[rand() % 7];
+			xq[i] = edges[rand() % 7];
+			break;
+		case 1:
+			xi[i] = (short)(rand() & 0xffff);
+			xq[i] = (short)(rand() & 0xffff);
+			break;
+		default:
+			xi[i] = (short)(rand() % 512 - 256);
+			xq[i] = (short)(rand() % 512 - 256);
+			break;
+		}
+	}
+	for (i = 0; i < sizeof(fxi) / sizeof(fxi[0]); i++) {
+		fxi[i] = (float)(rand() % 65536 - 32768);
+		fxq[i] = (float)(rand() % 65536 - 32768);
+	}
+}
+
+static void use(convert_isa_t isa)
+{
+	convert_use(isa);
+	dsp_init();
+	fft_setup();
+}
+
+// the whole input through one chain in runs of 1 to DSP_CHUNK samples, returns the output count
+static unsigned int run_chain(unsigned int c, unsigned int seed, short *yi, short *yq)
+{
+	unsigned int n, done, count = 0;
+	int r;
+
+	if (chains[c].ddc_rate) {
+		r = dsp_ddc_init(&decimator, chains[c].in_rate, chains[c].offset, chains[c].ddc_rate);
+	}
+	else {
+		r = dsp_decimator_init(&decimator, chains[c].factor, chains[c].in_rate, chains[c].out_rate);
+	}
+	if (r != 0) {
+		return 0;
+	}
+
+	// the same run lengths for every kernel set
+	srand(seed);
+	for (done = 0; done < CHECK_SAMPLES; done += n) {
+		n = (unsigned int)rand() % DSP_CHUNK + 1;
+		if (n > CHECK_SAMPLES - done) {
+			n = CHECK_SAMPLES - done;
+		}
+		count += dsp_decimate(&decimator, xi + done, xq + done, n, yi + count, yq + count);
+	}
+
+	return count;
+}
+
+static int check_chains(const char *name, convert_isa_t isa, unsigned int seed)
+{
+	unsigned int c, nref, nout;
+
+	for (c = 0; c < sizeof(chains) / sizeof(chains[0]); c++) {
+		use(CONVERT_ISA_SCALAR);
+		nref = run_chain(c, seed, ref_i, ref_q);
+		use(isa);
+		nout = run_chain(c, seed, out_i, out_q);
+
+		if (nref == 0) {
+			printf("chain %u cannot be set up\n", c);
+			return 1;
+		}
+		if (nref != nout || memcmp(ref_i, out_i, nref * sizeof(short)) || memcmp(ref_q, out_q, nref * sizeof(short))) {
+			printf("%s: chain %u (factor %u, %u -> %u Hz, offset %d, ddc %u Hz) differs from scalar\n", name, c,
+				chains[c].factor, chains[c].in_rate, chains[c].out_rate, chains[c].offset, chains[c].ddc_rate);
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+static unsigned int run_channelizer(unsigned int channels, unsigned int step, unsigned int phase, short *yi, short *yq)
+{
+	unsigned int bins[DSP_MAX_CHANNELS];
+	unsigned int c;
+
+	if (dsp_channelizer_init(&channelizer, channels, step) != 0) {
+		return 0;
+	}
+	for (c = 0; c < channels; c++) {
+		bins[c] = c ^ (channels / 2);
+	}
+	dsp_channelize(&channelizer, fxi, fxq, CHECK_ROWS, phase, bins, channels, yi, yq);
+	dsp_channelizer_free(&channelizer);
+
+	return CHECK_ROWS * channels;
+}
+
+static int check_channelizer(const char *name, convert_isa_t isa, unsigned int seed)
+{
+	unsigned int channels, step, phase, n;
+
+	for (channels = 2; channels <= DSP_MAX_CHANNELS; channels *= 2) {
+		for (step = channels; step >= channels / 2 && step > 0; step /= 2) {
+			phase = (seed * 7 + 1) & (channels - 1);
+
+			use(CONVERT_ISA_SCALAR);
+			n = run_channelizer(channels, step, phase, ref_i, ref_q);
+			use(isa);
+			if (n == 0 || run_channelizer(channels, step, phase, out_i, out_q) != n ||
+				memcmp(ref_i, out_i, n * sizeof(short)) || memcmp(ref_q, out_q, n * sizeof(short))) {
+				printf("%s: %u channels, step %u differ from scalar\n", name, channels, step);
+				return 1;
+			}
+		}
+	}
+
+	return 0;
+}
+
+static int run_fft(unsigned int n, float *re, float *im)
+{
+	fft_t f;
+
+	if (fft_init(&f, n) != 0) {
+		return -1;
+	}
+	memcpy(re, fxi, n * sizeof(float));
+	memcpy(im, fxq, n * sizeof(float));
+	fft_forward(&f, re, im, work);
+	fft_free(&f);
+
+	return 0;
+}
+
+static int check_fft(const char *name, convert_isa_t isa)
+{
+	unsigned int n;
+
+	for (n = FFT_MIN_SIZE; n <= FFT_MAX_SIZE; n *= 2) {
+		use(CONVERT_ISA_SCALAR);
+		if (run_fft(n, ref_re, ref_im) != 0) {
+			printf("no FFT of %u points\n", n);
+			return 1;
+		}
+		use(isa);
+		run_fft(n, out_re, out_im);
+
+		if (memcmp(ref_re, out_re, n * sizeof(float)) || memcmp(ref_im, out_im, n * sizeof(float))) {
+			printf("%s: %u point FFT differs from scalar\n", name, n);
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int k, seed;
+	int checked = 0;
+
+	for (k = 0; k < sizeof(isas) / sizeof(isas[0]); k++) {
+		if (convert_use(isas[k].isa) != 0) {
+			continue;
+		}
+		checked++;
+
+		for (seed = 1; seed <= 3; seed++) {
+			fill_input(seed);
+			if (check_chains(isas[k].name, isas[k].isa, seed) ||
+				check_channelizer(isas[k].name, isas[k].isa, seed) ||
+				check_fft(isas[k].name, isas[k].isa)) {
+				return 1;
+			}
+		}
+
+		printf("%s: identical to scalar\n", isas[k].name);
+	}
+
+	if (!checked) {
+		printf("no vector kernels in this build or on this CPU, nothing to check\n");
+	}
+
+	return 0;
+}
@@ -0,0 +1,269 @@
+/*
+* rsp_tcp - sample queue benchmark
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Compares the cost of handing one callback worth of samples to the sender
+ * thread, as seen by the callback thread: the old ll_buffers list (malloc
+ * per callback, walk to the tail under the mutex, drop when -n is reached)
+ * against the sample queue with its block pool.
+ *
+ * A producer thread plays the SDRplay callback at a fixed rate, a consumer
+ * thread drains the queue in bursts with a pause in between, like a sender
+ * waiting on a full socket, so the queue depth builds up the way it does
+ * on a slow link.
+ *
+ *   queue_bench [rate in S/s] [samples per callback] [consumer pause in ms] [seconds] [-n]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "rsp_tcp_queue.h"
+
+static unsigned int rate = 10000000;
+static unsigned int samples = 1008;
+static unsigned int pause_ms = 50;
+static unsigned int seconds = 5;
+static int llbuf_num = 500;
+
+static volatile int done = 0;
+
+// the callback data, interleaved int16 I/Q like the INT16 format
+static short source[2 * 65536];
+
+static unsigned long long now_ns(void)
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (unsigned long long)t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+static void sleep_until(unsigned long long ns)
+{
+	struct timespec t;
+
+	t.tv_sec = (time_t)(ns / 1000000000ULL);
+	t.tv_nsec = (long)(ns % 1000000000ULL);
+	clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &t, NULL);
+}
+
+static void sleep_ms(unsigned int ms)
+{
+	sleep_until(now_ns() + ms * 1000000ULL);
+}
+
+/* ******************************************************************************* */
+
+// the list and its handling as it was before the sample queue
+struct llist {
+	char *data;
+	size_t len;
+	struct llist *next;
+};
+
+static pthread_mutex_t ll_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t ll_cond = PTHREAD_COND_INITIALIZER;
+static struct llist *ll_buffers = NULL;
+static unsigned long long ll_dropped = 0;
+
+static void list_put(void)
+{
+	struct llist *rpt = (struct llist *)malloc(sizeof(struct llist));
+	struct llist *cur, *first;
+	int num_queued = 0;
+
+	rpt->data = (char *)malloc(4 * samples);
+	memcpy(rpt->data, source, 4 * samples);
+	rpt->len = 4 * samples;
+	rpt->next = NULL;
+
+	pthread_mutex_lock(&ll_mutex);
+	if (ll_buffers == NULL) {
+		ll_buffers = rpt;
+	}
+	else {
+		for (cur = ll_buffers; cur->next != NULL; cur = cur->next) {
+			num_queued++;
+		}
+		if (llbuf_num && llbuf_num == num_queued - 2) {
+			first = ll_buffers;
+			ll_buffers = first->next;
+			free(first->data);
+			free(first);
+			ll_dropped++;
+		}
+		cur->next = rpt;
+	}
+	pthread_cond_signal(&ll_cond);
+	pthread_mutex_unlock(&ll_mutex);
+}
+
+static unsigned long long list_dropped(void)
+{
+	return ll_dropped;
+}
+
+static void *list_consumer(void *arg)
+{
+	struct llist *cur, *next;
+	volatile char sink = 0;
+
+	while (!done) {
+		pthread_mutex_lock(&ll_mutex);
+		cur = ll_buffers;
+		ll_buffers = NULL;
+		pthread_mutex_unlock(&ll_mutex);
+
+		for (; cur != NULL; cur = next) {
+			sink += cur->data[0];
+			next = cur->next;
+			free(cur->data);
+			free(cur);
+		}
+		sleep_ms(pause_ms);
+	}
+
+	return NULL;
+}
+
+/* ******************************************************************************* */
+
+static sample_queue_t queue;
+static sample_pool_t pool;
+
+static void ring_put(void)
+{
+	struct sample_block *blk = sample_pool_get(&pool), *dropped;
+
+	if (blk == NULL) {
+		// nothing free, recycle the oldest queued block like -O oldest
+		blk = sample_queue_steal(&queue);
+		if (blk == NULL) {
+			return;
+		}
+		sample_queue_count_drop(&queue, blk);
+	}
+
+	memcpy(blk->data, source, 4 * samples);
+	blk->len = 4 * samples;
+	blk->samples = samples;
+
+	while (!sample_queue_has_room(&queue, blk->len) && (dropped = sample_queue_steal(&queue)) != NULL) {
+		sample_queue_count_drop(&queue, dropped);
+		sample_pool_put(&pool, dropped);
+	}
+	sample_queue_push(&queue, blk);
+	sample_queue_notify(&queue);
+}
+
+static unsigned long long ring_dropped(void)
+{
+	return queue.dropped_blocks;
+}
+
+static void *ring_consumer(void *arg)
+{
+	struct sample_block *blk;
+	volatile char sink = 0;
+
+	while (!done) {
+		while ((blk = sample_queue_pop(&queue)) != NULL) {
+			sink += blk->data[0];
+			sample_pool_put(&pool, blk);
+		}
+		sleep_ms(pause_ms);
+	}
+
+	return NULL;
+}
+
+/* ******************************************************************************* */
+
+static int compare_ull(const void *a, const void *b)
+{
+	unsigned long long x = *(const unsigned long long *)a, y = *(const unsigned long long *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static void run(const char *name, void (*put)(void), void *(*consumer)(void *), unsigned long long (*dropped)(void))
+{
+	unsigned long long period = (unsigned long long)samples * 1000000000ULL / rate;
+	unsigned long long start, next, t0, sum = 0;
+	unsigned long long *cost;
+	unsigned int i, count = (unsigned int)((unsigned long long)seconds * rate / samples);
+	pthread_t thread;
+
+	cost = (unsigned long long *)malloc(count * sizeof(unsigned long long));
+	done = 0;
+	pthread_create(&thread, NULL, consumer, NULL);
+
+	start = next = now_ns();
+	for (i = 0; i < count; i++) {
+		sleep_until(next);
+		next += period;
+
+		t0 = now_ns();
+		put();
+		cost[i] = now_ns() - t0;
+		sum += cost[i];
+	}
+
+	done = 1;
+	pthread_join(thread, NULL);
+
+	qsort(cost, count, sizeof(unsigned long long), compare_ull);
+	printf("%-6s %u callbacks in %.2f s: mean %6llu ns  p50 %6llu ns  p99 %7llu ns  max %8llu ns  dropped %llu\n",
+		name, count, (now_ns() - start) / 1e9, sum / count, cost[count / 2], cost[count - count / 100 - 1],
+		cost[count - 1], dropped());
+	free(cost);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int i;
+
+	if (argc > 1) rate = (unsigned int)atoi(argv[1]);
+	if (argc > 2) samples = (unsigned int)atoi(argv[2]);
+	if (argc > 3) pause_ms = (unsigned int)atoi(argv[3]);
+	if (argc > 4) seconds = (unsigned int)atoi(argv[4]);
+	if (argc > 5) llbuf_num = atoi(argv[5]);
+
+	if (rate == 0 || samples == 0 || samples > 65536 || seconds == 0) {
+		printf("usage: queue_bench [rate in S/s] [samples per callback] [consumer pause in ms] [seconds] [-n]\n");
+		return 1;
+	}
+
+	for (i = 0; i < 2 * samples; i++) {
+		source[i] = (short)(i * 37);
+	}
+
+	printf("%u S/s, %u samples per callback, consumer pause %u ms, -n %d\n", rate, samples, pause_ms, llbuf_num);
+
+	run("list", list_put, list_consumer, list_dropped);
+
+	if (sample_queue_init(&queue, llbuf_num) != 0 || sample_pool_init(&pool, llbuf_num + 1, 4 * samples) != 0) {
+		printf("out of memory\n");
+		return 1;
+	}
+	run("ring", ring_put, ring_consumer, ring_dropped);
+
+	return 0;
+}
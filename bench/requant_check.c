@@ -0,0 +1,156 @@
+/*
+* rsp_tcp - 8-bit requantizer check
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Spectral quality of the 8-bit output on synthetic complex tones: the
+ * truncation the server used to do, ((x << shift) >> 8) + 128, against the
+ * rounding kernel and the dithered one. The tone sits on an FFT bin that
+ * is odd, so the N samples take N different phases and the quantization
+ * error repeats exactly over the transform, with no window needed.
+ *
+ * SFDR is the tone over the strongest other bin, DC included, so the half
+ * LSB offset of truncation counts as the spur it is. The noise floor is the
+ * mean power of all other bins relative to the tone. Exits with 1 unless
+ * rounding and dither beat truncation on both.
+ *
+ *   requant_check
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "rsp_tcp_convert.h"
+#include "rsp_tcp_fft.h"
+
+#define CHECK_SIZE 65536
+#define CHECK_BIN 4099
+#define CHECK_SHIFT 2
+
+typedef enum {
+	MODE_TRUNCATE = 0,
+	MODE_ROUND = 1,
+	MODE_DITHER = 2
+} requant_mode_t;
+
+static const char *mode_names[] = { "truncate", "round", "dither" };
+
+// tone amplitudes in output LSB, a weak signal and one well above the quantization
+static const double amplitudes[] = { 3.3, 40.0 };
+
+static short xi[CHECK_SIZE], xq[CHECK_SIZE];
+static unsigned char out[2 * CHECK_SIZE];
+static float re[CHECK_SIZE], im[CHECK_SIZE], work[2 * CHECK_SIZE];
+
+typedef struct {
+	double sfdr_db;
+	double floor_dbc;
+} quality_t;
+
+static void fill_tone(double lsb)
+{
+	double a = lsb * (1 << (8 - CHECK_SHIFT));
+	unsigned int i;
+
+	for (i = 0; i < CHECK_SIZE; i++) {
+		xi[i] = (short)lrint(a * cos(2 * M_PI * CHECK_BIN * (double)i / CHECK_SIZE));
+		xq[i] = (short)lrint(a * sin(2 * M_PI * CHECK_BIN * (double)i / CHECK_SIZE));
+	}
+}
+
+static void requantize(requant_mode_t mode)
+{
+	unsigned int i;
+
+	if (mode != MODE_TRUNCATE) {
+		convert_select(RSP_TCP_SAMPLE_FORMAT_UINT8, CHECK_SHIFT, mode == MODE_DITHER)((char *)out, xi, xq, CHECK_SIZE);
+		return;
+	}
+
+	for (i = 0; i < CHECK_SIZE; i++) {
+		out[2 * i] = (unsigned char)(((xi[i] * (1 << CHECK_SHIFT)) >> 8) + 128);
+		out[2 * i + 1] = (unsigned char)(((xq[i] * (1 << CHECK_SHIFT)) >> 8) + 128);
+	}
+}
+
+static quality_t measure(const fft_t *f)
+{
+	quality_t q;
+	double p, tone, spur = 0, rest = 0;
+	unsigned int i;
+
+	for (i = 0; i < CHECK_SIZE; i++) {
+		re[i] = (float)(out[2 * i] - 128);
+		im[i] = (float)(out[2 * i + 1] - 128);
+	}
+	fft_forward(f, re, im, work);
+
+	tone = (double)re[CHECK_BIN] * re[CHECK_BIN] + (double)im[CHECK_BIN] * im[CHECK_BIN];
+	for (i = 0; i < CHECK_SIZE; i++) {
+		if (i == CHECK_BIN) {
+			continue;
+		}
+		p = (double)re[i] * re[i] + (double)im[i] * im[i];
+		rest += p;
+		if (p > spur) {
+			spur = p;
+		}
+	}
+
+	// a spectrum with nothing but the tone has no spur, it is as good as it gets
+	q.sfdr_db = spur > 0 ? 10 * log10(tone / spur) : INFINITY;
+	q.floor_dbc = rest > 0 ? 10 * log10(rest / (CHECK_SIZE - 1) / tone) : -INFINITY;
+	return q;
+}
+
+int main(int argc, char **argv)
+{
+	quality_t q[3];
+	fft_t f;
+	unsigned int a, m;
+	int failed = 0;
+
+	convert_init();
+	fft_setup();
+	if (fft_init(&f, CHECK_SIZE) != 0) {
+		printf("no FFT of %d points\n", CHECK_SIZE);
+		return 1;
+	}
+
+	printf("shift %d, tone on bin %d of %d, SFDR dB / noise floor dBc per bin\n", CHECK_SHIFT, CHECK_BIN, CHECK_SIZE);
+	for (a = 0; a < sizeof(amplitudes) / sizeof(amplitudes[0]); a++) {
+		fill_tone(amplitudes[a]);
+
+		printf("%5.1f LSB", amplitudes[a]);
+		for (m = MODE_TRUNCATE; m <= MODE_DITHER; m++) {
+			requantize((requant_mode_t)m);
+			q[m] = measure(&f);
+			printf("  %s %6.1f / %6.1f", mode_names[m], q[m].sfdr_db, q[m].floor_dbc);
+		}
+		printf("\n");
+
+		for (m = MODE_ROUND; m <= MODE_DITHER; m++) {
+			if (q[m].sfdr_db <= q[MODE_TRUNCATE].sfdr_db || q[m].floor_dbc >= q[MODE_TRUNCATE].floor_dbc) {
+				printf("%s does not beat truncation at %.1f LSB\n", mode_names[m], amplitudes[a]);
+				failed = 1;
+			}
+		}
+	}
+
+	fft_free(&f);
+	return failed;
+}
@@ -0,0 +1,166 @@
+/*
+* rsp_tcp - software rate conversion benchmark
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Cost of the decimator chain of the conversion thread for the ratios
+ * plan_sample_rate() sets up when the device runs at a fixed native rate
+ * (-r): cycles per output sample, and the input rate one core keeps up
+ * with, for scalar and every vector set the build and the CPU have. The
+ * input is fed in DSP_CHUNK runs like the conversion thread does.
+ *
+ * Cycles are TSC ticks on x86. Elsewhere the figure is ns per sample.
+ *
+ *   resample_bench [seconds per case]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "rsp_tcp_convert.h"
+#include "rsp_tcp_dsp.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_UNIT "cycles"
+static unsigned long long ticks(void)
+{
+	return __rdtsc();
+}
+#else
+#define BENCH_UNIT "ns"
+static unsigned long long ticks(void)
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (unsigned long long)t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+#endif
+
+static double seconds = 1.0;
+
+// input samples of the benchmark, cycled through
+#define BENCH_SAMPLES (64 * DSP_CHUNK)
+
+static short xi[BENCH_SAMPLES], xq[BENCH_SAMPLES];
+static short yi[DSP_CHUNK + 1], yq[DSP_CHUNK + 1];
+static dsp_decimator_t decimator;
+
+/*
+ * The software factor and resampler rates plan_sample_rate() picks for a
+ * native and a client rate: the resampler rates are the native rate and
+ * the client rate times the hardware and software decimation, the chain
+ * itself runs on the native rate after the hardware decimation. The last
+ * case is a rate below the hardware decimation without -r, which takes
+ * the half-bands and the FIR alone.
+ */
+static const struct {
+	const char *name;
+	unsigned int factor;
+	unsigned int in_rate, out_rate;
+} cases[] = {
+	{ "2.048M -> 2M", 1, 2048000, 2000000 },
+	{ "10M -> 8M", 1, 10000000, 8000000 },
+	{ "10M -> 2.4M", 1, 10000000, 9600000 },
+	{ "8M -> 3.2M", 1, 8000000, 6400000 },
+	{ "10M -> 1.024M", 1, 10000000, 8192000 },
+	{ "8M -> 48k", 2, 8000000, 6144000 },
+	{ "12k, no -r", 3, 0, 0 }
+};
+
+static const struct {
+	convert_isa_t isa;
+	const char *name;
+} isas[] = {
+	{ CONVERT_ISA_SCALAR, "scalar" },
+	{ CONVERT_ISA_SSE2, "sse2" },
+	{ CONVERT_ISA_AVX2, "avx2" },
+	{ CONVERT_ISA_NEON, "neon" }
+};
+
+static double now_s(void)
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+// runs one case for the given time, prints ticks per output sample and input MS/s
+static void run(unsigned int c)
+{
+	unsigned long long in = 0, out = 0, t0;
+	unsigned int pos = 0;
+	double s0, t;
+
+	if (dsp_decimator_init(&decimator, cases[c].factor, cases[c].in_rate, cases[c].out_rate) != 0) {
+		printf(" %20s", "n/a");
+		return;
+	}
+
+	s0 = now_s();
+	t0 = ticks();
+	do {
+		out += dsp_decimate(&decimator, xi + pos, xq + pos, DSP_CHUNK, yi, yq);
+		in += DSP_CHUNK;
+		pos = (pos + DSP_CHUNK) % BENCH_SAMPLES;
+	} while ((in & (64 * DSP_CHUNK - 1)) || now_s() - s0 < seconds);
+	t0 = ticks() - t0;
+	t = now_s() - s0;
+
+	printf(" %9.1f %10.1f", (double)t0 / out, in / t / 1e6);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int i, k, c;
+
+	if (argc > 1) seconds = atof(argv[1]);
+	if (seconds <= 0) {
+		printf("usage: resample_bench [seconds per case]\n");
+		return 1;
+	}
+
+	srand(1);
+	for (i = 0; i < BENCH_SAMPLES; i++) {
+		xi[i] = (short)(rand() % 8192 - 4096);
+		xq[i] = (short)(rand() % 8192 - 4096);
+	}
+
+	printf(BENCH_UNIT " per output sample and input MS/s per core\n%-14s", "");
+	for (k = 0; k < sizeof(isas) / sizeof(isas[0]); k++) {
+		if (convert_use(isas[k].isa) == 0) {
+			printf(" %20s", isas[k].name);
+		}
+	}
+	printf("\n");
+
+	for (c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+		printf("%-14s", cases[c].name);
+		for (k = 0; k < sizeof(isas) / sizeof(isas[0]); k++) {
+			if (convert_use(isas[k].isa) != 0) {
+				continue;
+			}
+			dsp_init();
+			run(c);
+		}
+		printf("\n");
+	}
+
+	return 0;
+}
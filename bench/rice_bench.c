@@ -0,0 +1,187 @@
+/*
+* rsp_tcp - Rice coding benchmark
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Throughput of the RSP_TCP_SAMPLE_FORMAT_RICE16 encoder of the conversion
+ * thread and of the reference decoder rsp_tcp_unpack_rice(), counted on the
+ * int16 I/Q samples (4 bytes per sample), with the compression ratio, for a
+ * few kinds of input: low level noise as from an idle band, a strong tone
+ * over that noise, and full scale noise that is mostly escaped. Every
+ * decoded buffer is compared with the input.
+ *
+ *   rice_bench [samples per signal] [rounds]
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "rsp_tcp_rice.h"
+
+static unsigned int samples = 1 << 20;
+static unsigned int rounds = 10;
+
+static short *xi, *xq, *dec;
+static char *enc;
+
+static double now_s(void)
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static short noise(int amp)
+{
+	return (short)(rand() % (2 * amp + 1) - amp);
+}
+
+static void fill_input(int kind)
+{
+	unsigned int i;
+
+	srand(1);
+	for (i = 0; i < samples; i++) {
+		switch (kind) {
+		case 0:
+			xi[i] = noise(32);
+			xq[i] = noise(32);
+			break;
+		case 1:
+			xi[i] = (short)(8000 * cos(0.01 * i)) + noise(32);
+			xq[i] = (short)(8000 * sin(0.01 * i)) + noise(32);
+			break;
+		default:
+			xi[i] = (short)(rand() & 0xffff);
+			xq[i] = (short)(rand() & 0xffff);
+			break;
+		}
+	}
+}
+
+// encodes all samples in blocks, returns the coded size
+static size_t encode_all(rice_stats_t *stats)
+{
+	size_t len = 0;
+	unsigned int i, n;
+
+	for (i = 0; i < samples; i += n) {
+		n = samples - i < RSP_TCP_RICE_BLOCK_SAMPLES ? samples - i : RSP_TCP_RICE_BLOCK_SAMPLES;
+		len += rice_encode(enc + len, xi + i, xq + i, n, stats);
+	}
+
+	return len;
+}
+
+// decodes len bytes of blocks, returns the number of samples or 0 on a damaged block
+static unsigned int decode_all(size_t len)
+{
+	unsigned int n, total = 0;
+	size_t pos = 0;
+
+	while (pos < len) {
+		n = rsp_tcp_unpack_rice((const unsigned char *)enc + pos, dec + 2 * total);
+		if (n == 0) {
+			return 0;
+		}
+		total += n;
+		pos += (unsigned int)(unsigned char)enc[pos] << 8 | (unsigned char)enc[pos + 1];
+	}
+
+	return total;
+}
+
+static int check_output(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < samples; i++) {
+		if (dec[2 * i] != xi[i] || dec[2 * i + 1] != xq[i]) {
+			printf("sample %u decodes to %d,%d, input %d,%d\n", i, dec[2 * i], dec[2 * i + 1], xi[i], xq[i]);
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	static const char *names[] = { "idle noise", "tone", "full scale" };
+	rice_stats_t stats;
+	double t0, enc_best, dec_best, t;
+	unsigned int kind, r;
+	size_t len = 0;
+
+	if (argc > 1) samples = (unsigned int)atoi(argv[1]);
+	if (argc > 2) rounds = (unsigned int)atoi(argv[2]);
+
+	if (samples == 0 || rounds == 0) {
+		printf("usage: rice_bench [samples per signal] [rounds]\n");
+		return 1;
+	}
+
+	xi = (short *)malloc(samples * sizeof(short));
+	xq = (short *)malloc(samples * sizeof(short));
+	dec = (short *)malloc(samples * 2 * sizeof(short));
+	enc = (char *)malloc((samples / RSP_TCP_RICE_BLOCK_SAMPLES + 1) * RICE_MAX_BLOCK_BYTES(RSP_TCP_RICE_BLOCK_SAMPLES));
+	if (xi == NULL || xq == NULL || dec == NULL || enc == NULL) {
+		printf("out of memory\n");
+		return 1;
+	}
+
+	printf("%u samples, best of %u rounds, MB/s of int16 input\n", samples, rounds);
+	printf("%-12s %10s %10s %8s %10s\n", "", "encode", "decode", "ratio", "escapes");
+
+	for (kind = 0; kind < sizeof(names) / sizeof(names[0]); kind++) {
+		fill_input(kind);
+
+		enc_best = dec_best = 0;
+		for (r = 0; r < rounds; r++) {
+			memset(&stats, 0, sizeof(stats));
+			t0 = now_s();
+			len = encode_all(&stats);
+			t = now_s() - t0;
+			if (enc_best == 0 || t < enc_best) {
+				enc_best = t;
+			}
+
+			t0 = now_s();
+			if (decode_all(len) != samples) {
+				printf("%-12s damaged block\n", names[kind]);
+				return 1;
+			}
+			t = now_s() - t0;
+			if (dec_best == 0 || t < dec_best) {
+				dec_best = t;
+			}
+		}
+
+		if (check_output()) {
+			return 1;
+		}
+
+		printf("%-12s %10.1f %10.1f %8.2f %9.2f%%\n", names[kind],
+			samples * 4.0 / enc_best / 1e6, samples * 4.0 / dec_best / 1e6,
+			samples * 4.0 / len, 100.0 * stats.escapes / (2.0 * samples));
+	}
+
+	return 0;
+}
@@ -0,0 +1,214 @@
+/*
+* rsp_tcp - transmit path benchmark
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Throughput of the tcp worker's send paths over a loopback connection:
+ * one vectored sendmsg() per batch of frames, against the io_uring chain of
+ * linked sends of tcp_uring_send(), with and without the frame slab
+ * registered as fixed buffer. A reader thread drains the other end as fast
+ * as it can, the sender CPU time per MB shows what the path costs the worker.
+ *
+ *   send_bench [frame bytes] [frames per batch] [seconds]
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include "rsp_tcp_uring.h"
+
+// frames in the slab, sent round robin like the pool hands them out
+#define SLAB_FRAMES 64
+
+static size_t frame_bytes = 131072;
+static unsigned int batch = 16;
+static unsigned int seconds = 5;
+
+static char *slab;
+
+static double now_s(void)
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static double thread_cpu_s(void)
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t);
+	return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static void *reader(void *arg)
+{
+	int s = *(int *)arg;
+	static char buf[1 << 20];
+
+	while (recv(s, buf, sizeof(buf), 0) > 0) {
+	}
+
+	return NULL;
+}
+
+// connected loopback pair, the reader gets the accepted end
+static int connect_pair(int *rx)
+{
+	struct sockaddr_in addr;
+	socklen_t len = sizeof(addr);
+	int l, s;
+
+	l = socket(AF_INET, SOCK_STREAM, 0);
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (l < 0 || bind(l, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(l, 1) != 0 ||
+		getsockname(l, (struct sockaddr *)&addr, &len) != 0) {
+		return -1;
+	}
+
+	s = socket(AF_INET, SOCK_STREAM, 0);
+	if (s < 0 || connect(s, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+		return -1;
+	}
+	*rx = accept(l, NULL, NULL);
+	close(l);
+
+	return *rx < 0 ? -1 : s;
+}
+
+static long send_msg(int s, struct iovec *iov, int count)
+{
+	struct msghdr msg;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = iov;
+	msg.msg_iovlen = count;
+	return (long)sendmsg(s, &msg, MSG_NOSIGNAL);
+}
+
+static void run(const char *name, long (*send_fn)(int, struct iovec *, int))
+{
+	struct iovec iov[SLAB_FRAMES];
+	pthread_t thread;
+	unsigned long long bytes = 0;
+	unsigned int i, next = 0;
+	int first, s, rx, failed = 0;
+	long sent;
+	double t0, c0, t, c;
+
+	s = connect_pair(&rx);
+	if (s < 0) {
+		printf("%-12s loopback connection failed (%s)\n", name, strerror(errno));
+		return;
+	}
+	pthread_create(&thread, NULL, reader, &rx);
+
+	t0 = now_s();
+	c0 = thread_cpu_s();
+	while (!failed && now_s() - t0 < seconds) {
+		for (i = 0; i < batch; i++) {
+			iov[i].iov_base = slab + (size_t)next * frame_bytes;
+			iov[i].iov_len = frame_bytes;
+			next = (next + 1) % SLAB_FRAMES;
+		}
+
+		// the same partial send handling as the tcp worker
+		first = 0;
+		while (first < (int)batch) {
+			sent = send_fn(s, &iov[first], batch - first);
+			if (sent < 0) {
+				printf("%-12s send failed (%s)\n", name, strerror(errno));
+				failed = 1;
+				break;
+			}
+			bytes += sent;
+			while (first < (int)batch && (size_t)sent >= iov[first].iov_len) {
+				sent -= iov[first].iov_len;
+				first++;
+			}
+			if (first < (int)batch) {
+				iov[first].iov_base = (char *)iov[first].iov_base + sent;
+				iov[first].iov_len -= sent;
+			}
+		}
+	}
+	t = now_s() - t0;
+	c = thread_cpu_s() - c0;
+
+	shutdown(s, SHUT_WR);
+	pthread_join(thread, NULL);
+	close(s);
+	close(rx);
+
+	if (!failed) {
+		printf("%-12s %8.1f MB/s  %6.1f ms CPU per 100 MB\n", name, bytes / t / 1e6, c * 1e11 / bytes);
+	}
+}
+
+#ifdef HAVE_LIBURING
+static void run_uring(const char *name, int fixed)
+{
+	if (tcp_uring_init(SLAB_FRAMES, fixed ? slab : NULL, (size_t)SLAB_FRAMES * frame_bytes) != 0) {
+		return;
+	}
+	run(name, tcp_uring_send);
+	tcp_uring_exit();
+}
+#endif
+
+int main(int argc, char **argv)
+{
+	if (argc > 1) frame_bytes = (size_t)atoi(argv[1]);
+	if (argc > 2) batch = (unsigned int)atoi(argv[2]);
+	if (argc > 3) seconds = (unsigned int)atoi(argv[3]);
+
+	if (frame_bytes == 0 || batch == 0 || batch > SLAB_FRAMES || seconds == 0) {
+		printf("usage: send_bench [frame bytes] [frames per batch, up to %d] [seconds]\n", SLAB_FRAMES);
+		return 1;
+	}
+
+	slab = (char *)malloc((size_t)SLAB_FRAMES * frame_bytes);
+	if (slab == NULL) {
+		printf("out of memory\n");
+		return 1;
+	}
+	memset(slab, 0x5a, (size_t)SLAB_FRAMES * frame_bytes);
+
+	printf("%lu byte frames, %u per batch, %u s each\n", (unsigned long)frame_bytes, batch, seconds);
+
+	run("sendmsg", send_msg);
+#ifdef HAVE_LIBURING
+	run_uring("uring", 0);
+	run_uring("uring-fixed", 1);
+#else
+	printf("io_uring not compiled in, liburing was not found\n");
+#endif
+
+	free(slab);
+	return 0;
+}
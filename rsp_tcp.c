@@ -26,6 +26,13 @@
 #include <time.h>
 
 #include "rsp_tcp_api.h"
+#include "rsp_tcp_convert.h"
+#include "rsp_tcp_chan.h"
+#include "rsp_tcp_dsp.h"
+#include "rsp_tcp_queue.h"
+#include "rsp_tcp_rice.h"
+#include "rsp_tcp_spectrum.h"
+#include "rsp_tcp_uring.h"
 
 #ifndef _WIN32
 #include <unistd.h>
@@ -34,8 +41,19 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <sys/time.h>
+#include <sys/uio.h>
 #include <netinet/in.h>
 #include <fcntl.h>
+#ifdef __linux__
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <linux/errqueue.h>
+#define HAVE_EPOLL
+#if defined(SO_ZEROCOPY) && defined(MSG_ZEROCOPY) && defined(SO_EE_ORIGIN_ZEROCOPY)
+#define HAVE_ZEROCOPY
+#endif
+#endif
 #define CTRL_C_EVENT        0
 #define CTRL_BREAK_EVENT    1
 #define CTRL_CLOSE_EVENT    2
@@ -69,15 +87,19 @@ static int grc = 0;
 static int timeout = 500;
 static pthread_t tcp_worker_thread;
 static pthread_t command_thread;
+static pthread_t convert_thread;
 
-static pthread_mutex_t ll_mutex;
-static pthread_cond_t cond;
+static sample_queue_t sample_queue;
+static sample_pool_t sample_pool;
+static struct sample_block *spare_blocks = NULL;
 
-struct llist {
-	char *data;
-	size_t len;
-	struct llist *next;
-};
+// raw int16 blocks handed from the stream callback to the conversion stage
+static sample_queue_t raw_queue;
+static sample_pool_t raw_pool;
+
+// raw blocks keep I and Q planar, each half of the block holds one of them
+#define RAW_I(blk) ((short *)(blk)->data)
+#define RAW_Q(blk) ((short *)((blk)->data + (blk)->size / 2))
 
 typedef struct { /* structure size must be multiple of 2 bytes */
 	char magic[4];
@@ -114,34 +136,173 @@ double atofs(char *s)
 	return atof(s);
 }
 
-static int global_numq = 0;
-static struct llist *ll_buffers = 0;
-static int llbuf_num = 500;
+#define DEFAULT_FRAME_BYTES (131072)
+#define MIN_FRAME_BYTES (4096)
+#define DEFAULT_FRAME_MAX_AGE_US (5000)
+#define FRAME_RECHECK_US (1000)
+
+static unsigned int global_numq = 0;
+static int llbuf_num = -1;
+static unsigned int queue_max_ms = 0;
+static size_t queue_max_bytes = 0;
+static size_t frame_bytes = DEFAULT_FRAME_BYTES;
+static unsigned int frame_max_age = DEFAULT_FRAME_MAX_AGE_US;
+
+// threads of the channelizer, 0 for one per processor
+static unsigned int channel_threads = 0;
 
 static int overload = 0;
 
 static volatile int do_exit = 0;
 static volatile int ctrlC_exit = 0;
 
+#ifdef HAVE_EPOLL
+/*
+ * On Linux the socket threads sleep in epoll instead of select(). exit_event
+ * stays readable while do_exit is set so every loop notices it right away,
+ * sample_event wakes the tcp worker when the conversion thread queues a frame.
+ * A full socket is waited for in send_epoll, which leaves sample_event out: it
+ * is only drained by wait_samples() and would keep epoll_wait() returning.
+ */
+static int exit_event = -1;
+static int sample_event = -1;
+static int listen_epoll = -1;
+static int worker_epoll = -1;
+static int send_epoll = -1;
+static int command_epoll = -1;
+
+static void signal_exit_event()
+{
+	uint64_t one = 1;
+
+	if (exit_event >= 0 && write(exit_event, &one, sizeof(one)) < 0) {
+		// already signalled
+	}
+}
+
+static void clear_exit_event()
+{
+	uint64_t value;
+
+	if (read(exit_event, &value, sizeof(value)) < 0) {
+		// was not signalled
+	}
+}
+
+// epoll set watching exit_event, the socket (edge triggered) and an optional eventfd
+static int create_epoll(int sock, uint32_t events, int event)
+{
+	struct epoll_event ev;
+	int ep;
+
+	ep = epoll_create1(EPOLL_CLOEXEC);
+	if (ep < 0) {
+		return -1;
+	}
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.fd = exit_event;
+	epoll_ctl(ep, EPOLL_CTL_ADD, exit_event, &ev);
+
+	if (event >= 0) {
+		ev.events = EPOLLIN;
+		ev.data.fd = event;
+		epoll_ctl(ep, EPOLL_CTL_ADD, event, &ev);
+	}
+
+	ev.events = events | EPOLLET;
+	ev.data.fd = sock;
+	if (epoll_ctl(ep, EPOLL_CTL_ADD, sock, &ev) != 0) {
+		close(ep);
+		return -1;
+	}
+
+	return ep;
+}
+
+static void wait_epoll(int ep, int timeout_ms)
+{
+	struct epoll_event events[4];
+
+	epoll_wait(ep, events, 4, timeout_ms);
+}
+
+// sleep until the conversion thread queues a frame, returns ETIMEDOUT if none came
+static int wait_samples(int timeout_ms)
+{
+	struct timeval start, now;
+	uint64_t value;
+	int elapsed = 0;
+
+	gettimeofday(&start, NULL);
+	while (sample_queue_arm(&sample_queue) == 0) {
+		if (elapsed >= timeout_ms || do_exit) {
+			sample_queue_disarm(&sample_queue);
+			return ETIMEDOUT;
+		}
+
+		// socket edges wake us up as well, so go round until the deadline
+		wait_epoll(worker_epoll, timeout_ms - elapsed);
+		sample_queue_disarm(&sample_queue);
+		if (read(sample_event, &value, sizeof(value)) < 0) {
+			// woken by something else
+		}
+
+		gettimeofday(&now, NULL);
+		elapsed = (int)((now.tv_sec - start.tv_sec) * 1000 + (now.tv_usec - start.tv_usec) / 1000);
+	}
+
+	return 0;
+}
+#endif
+
 #define RSP_TCP_VERSION_MAJOR (1)
 #define RSP_TCP_VERSION_MINOR (1)
 
 #define MAX_DECIMATION_FACTOR (64)
+#define MIN_SAMPLERATE (1000)
 #define MAX_DEVS 4
 #define WORKER_TIMEOUT_SEC 3
 #define DEFAULT_BW_T sdrplay_api_BW_1_536
 #define DEFAULT_FREQUENCY (100000000)
 #define DEFAULT_SAMPLERATE (2000000)
+#define MAX_SAMPLERATE (10000000)
 #define DEFAULT_AGC_SETPOINT -30
 #define DEFAULT_GAIN_REDUCTION 40
 #define DEFAULT_LNA_STATE 4
 #define DEFAULT_AGC_STATE 1
+#define DEFAULT_LLBUF_NUM 500
+#define DEFAULT_OVERFLOW_BLOCK_MS 100
+#define DEFAULT_SPECTRUM_RATE 25
+#define POOL_SLACK_BLOCKS 8
+#define ZEROCOPY_MAX_PENDING 32
+#define RAW_QUEUE_MS 200
+#define RAW_BLOCK_SAMPLES 2048
 #define RTLSDR_TUNER_R820T 5
 
+// formats a client can switch to with RSP_TCP_COMMAND_SET_SAMPLE_FORMAT
+#define SUPPORTED_SAMPLE_FORMATS (RSP_TCP_SAMPLE_FORMAT_BIT(RSP_TCP_SAMPLE_FORMAT_UINT8) | \
+	RSP_TCP_SAMPLE_FORMAT_BIT(RSP_TCP_SAMPLE_FORMAT_INT16) | \
+	RSP_TCP_SAMPLE_FORMAT_BIT(RSP_TCP_SAMPLE_FORMAT_FLOAT32) | \
+	RSP_TCP_SAMPLE_FORMAT_BIT(RSP_TCP_SAMPLE_FORMAT_PACKED10) | \
+	RSP_TCP_SAMPLE_FORMAT_BIT(RSP_TCP_SAMPLE_FORMAT_PACKED12) | \
+	RSP_TCP_SAMPLE_FORMAT_BIT(RSP_TCP_SAMPLE_FORMAT_PACKED14) | \
+	RSP_TCP_SAMPLE_FORMAT_BIT(RSP_TCP_SAMPLE_FORMAT_BFP8) | \
+	RSP_TCP_SAMPLE_FORMAT_BIT(RSP_TCP_SAMPLE_FORMAT_BFP6) | \
+	RSP_TCP_SAMPLE_FORMAT_BIT(RSP_TCP_SAMPLE_FORMAT_RICE16))
+
 static int bwType = sdrplay_api_BW_Undefined;
 static int last_gain_idx = 0;
 static int verbose = 0;
 static uint8_t max_lnastate;
+static sample_queue_policy_t overflow_policy = SAMPLE_QUEUE_DROP_OLDEST;
+static unsigned int overflow_block_ms = DEFAULT_OVERFLOW_BLOCK_MS;
+static int zerocopy = 0;
+static int use_uring = 0;
+#ifdef HAVE_LIBURING
+static int uring_active = 0;
+#endif
 
 sdrplay_api_DeviceT devices[MAX_DEVS];
 sdrplay_api_DeviceT *chosenDev;
@@ -516,7 +677,19 @@ static int extended_mode = 0;
 static int hardware_version = 0;
 static rsp_capabilities_t *hardware_caps = NULL;
 static rsp_model_t hardware_model = RSP_MODEL_UNKNOWN;
+static rsp_tcp_sample_format_t default_sample_format = RSP_TCP_SAMPLE_FORMAT_UINT8;
 static rsp_tcp_sample_format_t sample_format = RSP_TCP_SAMPLE_FORMAT_UINT8;
+static volatile rsp_tcp_sample_format_t requested_sample_format = RSP_TCP_SAMPLE_FORMAT_UINT8;
+
+// set once the client asked for automatic scaling, the stream then carries the shift
+static volatile int shift_markers = 0;
+
+// set once the client used the down-converter or channelizer, the stream then carries the rate
+static volatile int rate_markers = 0;
+
+// set once the client used the channelizer, the stream then carries the channel count
+static volatile int channel_markers = 0;
+
 static rsp_band_t current_band = BAND_UNKNOWN;
 static int current_antenna_input = 0;
 static unsigned int current_frequency;
@@ -524,7 +697,9 @@ static int lna_state = DEFAULT_LNA_STATE;
 static int agc_state = DEFAULT_AGC_STATE;
 static int agc_set_point = DEFAULT_AGC_SETPOINT;
 static int gain_reduction = DEFAULT_GAIN_REDUCTION;
-static int sample_shift = 2;
+#define DEFAULT_SAMPLE_SHIFT 2
+static int sample_shift = DEFAULT_SAMPLE_SHIFT;
+static int dither = 0;
 
 // *************************************
 
@@ -571,6 +746,9 @@ static void sighandler(int signum)
 {
 	fprintf(stderr, "Signal (%d) caught, ask for exit!\n", signum);
 	do_exit = 1;
+#ifdef HAVE_EPOLL
+	signal_exit_event();
+#endif
 }
 #endif
 
@@ -616,6 +794,223 @@ void event_callback(sdrplay_api_EventT eventId, sdrplay_api_TunerSelectT tunerS,
 	}
 }
 
+#define MAX_OUTPUT_SAMPLE_SIZE (2 * sizeof(float))
+
+// bytes per sample, fractional for the packed formats
+static double output_sample_size()
+{
+	return (double)convert_group_bytes(sample_format) / convert_group_samples(sample_format);
+}
+
+// the most the queue can hold at the highest sample rate, in a format of sample_size bytes
+static size_t queue_budget_bytes(size_t sample_size)
+{
+	size_t max_bytes = queue_max_bytes;
+	size_t limit_bytes;
+
+	if (queue_max_ms) {
+		limit_bytes = (size_t)((double)MAX_SAMPLERATE * queue_max_ms / 1000.0) * sample_size;
+		if (max_bytes == 0 || limit_bytes < max_bytes) {
+			max_bytes = limit_bytes;
+		}
+	}
+	if (llbuf_num) {
+		limit_bytes = (size_t)llbuf_num * RAW_BLOCK_SAMPLES * sample_size;
+		if (max_bytes == 0 || limit_bytes < max_bytes) {
+			max_bytes = limit_bytes;
+		}
+	}
+
+	return max_bytes;
+}
+
+static unsigned int pool_block_count(size_t block_size)
+{
+	// sized for the widest format a client can switch to
+	size_t max_bytes = queue_budget_bytes(MAX_OUTPUT_SAMPLE_SIZE);
+	unsigned int count;
+
+	// full frames, as a frame flushed for its age only goes in when the queue is empty,
+	// plus that one partial frame and the frame being filled
+	count = (unsigned int)(max_bytes / block_size + 2);
+	if (count > SAMPLE_QUEUE_MAX_BLOCKS) {
+		count = SAMPLE_QUEUE_MAX_BLOCKS;
+	}
+
+	// frames waiting for their zero-copy completion are not in the queue
+	if (zerocopy) {
+		count += ZEROCOPY_MAX_PENDING;
+	}
+
+	return count + POOL_SLACK_BLOCKS;
+}
+
+// client rate as the command thread sees it, the conversion thread goes by stream_rate
+static uint32_t current_samp_rate = DEFAULT_SAMPLERATE;
+
+// device rate the client rates are resampled from, 0 to run the device at the client rate
+static uint32_t native_samp_rate = 0;
+
+static unsigned int raw_pool_count(void)
+{
+	// the highest rate the session can reach, a client can ask for any rate unless -r fixes it
+	uint32_t sr = native_samp_rate ? native_samp_rate : MAX_SAMPLERATE;
+	unsigned int ms = RAW_QUEUE_MS;
+
+	// the conversion stage can be held up for the whole -O block wait
+	if (overflow_policy == SAMPLE_QUEUE_BLOCK && 2 * overflow_block_ms > ms) {
+		ms = 2 * overflow_block_ms;
+	}
+
+	// a callback starts a new block, so each block is at least half full for callbacks from half a block up
+	return (unsigned int)((unsigned long long)sr * ms / 1000 / (RAW_BLOCK_SAMPLES / 2) + 1);
+}
+
+// down-converter or channelizer of the client, the conversion thread takes them over when output_changed is set, which is stored last with release
+static volatile int32_t requested_ddc_offset = 0;
+static volatile uint32_t requested_ddc_rate = 0;
+static volatile unsigned int requested_channels = 0;
+static volatile unsigned int requested_channel_step = 0;
+static volatile unsigned int requested_channel_mask[CHAN_MASK_WORDS];
+static volatile int output_changed = 0;
+
+// spectrum frames in place of the samples, taken over with output_changed as well
+static volatile unsigned int requested_spectrum_size = 0;
+static volatile rsp_tcp_spectrum_window_t requested_spectrum_window = RSP_TCP_SPECTRUM_WINDOW_HANN;
+static volatile unsigned int requested_spectrum_average = 0;
+static volatile unsigned int requested_spectrum_rate = DEFAULT_SPECTRUM_RATE;
+
+static void keep_spare_block(struct sample_block *blk)
+{
+	blk->next = spare_blocks;
+	spare_blocks = blk;
+}
+
+static struct sample_block *get_block()
+{
+	struct sample_block *blk = spare_blocks;
+
+	if (blk) {
+		spare_blocks = blk->next;
+	}
+	else {
+		blk = sample_pool_get(&sample_pool);
+		if (blk == NULL && overflow_policy == SAMPLE_QUEUE_DROP_OLDEST) {
+			// nothing free, recycle the oldest queued frame rather than stall
+			blk = sample_queue_steal(&sample_queue);
+			if (blk) {
+				sample_queue_count_drop(&sample_queue, blk);
+			}
+		}
+	}
+
+	if (blk) {
+		blk->len = 0;
+	}
+
+	return blk;
+}
+
+// set while -O block discards, see enqueue_block()
+static int block_stalled = 0;
+
+static void enqueue_block(struct sample_block *rpt)
+{
+	struct sample_block *dropped;
+	unsigned int num_queued;
+	struct timespec ts;
+	struct timeval tp;
+
+	switch (overflow_policy) {
+	case SAMPLE_QUEUE_BLOCK:
+		// after a wait ran out the blocks behind it are discarded right away until there is room
+		// again, waiting for each of them would hold up the conversion stage for good
+		if (sample_queue_has_room(&sample_queue, rpt->len)) {
+			block_stalled = 0;
+		}
+		else if (!block_stalled) {
+			gettimeofday(&tp, NULL);
+			tp.tv_usec += overflow_block_ms * 1000;
+			ts.tv_sec = tp.tv_sec + tp.tv_usec / 1000000;
+			ts.tv_nsec = (tp.tv_usec % 1000000) * 1000;
+			block_stalled = sample_queue_wait_room(&sample_queue, rpt->len, &ts) != 0;
+		}
+		/* fall-through */
+	case SAMPLE_QUEUE_DROP_NEWEST:
+		if (!sample_queue_has_room(&sample_queue, rpt->len)) {
+			sample_queue_count_drop(&sample_queue, rpt);
+			keep_spare_block(rpt);
+			return;
+		}
+		break;
+
+	default:
+		// drop the oldest blocks until the new one fits in the queue limits,
+		// they come back to the producer and are reused by the next callbacks
+		while (!sample_queue_has_room(&sample_queue, rpt->len) &&
+			(dropped = sample_queue_steal(&sample_queue)) != NULL) {
+			sample_queue_count_drop(&sample_queue, dropped);
+			keep_spare_block(dropped);
+		}
+		break;
+	}
+
+	sample_queue_push(&sample_queue, rpt);
+	sample_queue_notify(&sample_queue);
+
+	if (verbose) {
+		num_queued = sample_queue_count(&sample_queue);
+		if (num_queued > global_numq)
+			printf("queue+, now %u\n", num_queued);
+		else if (num_queued < global_numq)
+			printf("queue-, now %u\n", num_queued);
+		global_numq = num_queued;
+	}
+}
+
+// set whenever sample_format or sample_shift changes
+static convert_fn sample_converter = NULL;
+
+static void update_converter()
+{
+	sample_converter = convert_select(sample_format, sample_shift, dither);
+}
+
+static void queue_samples(short *xi, short *xq, unsigned int numSamples)
+{
+	unsigned int n;
+	struct sample_block *raw;
+
+	// only copy the samples here, the conversion stage does the rest
+	while (numSamples > 0) {
+		raw = sample_pool_get(&raw_pool);
+		if (raw == NULL) {
+			// conversion stage is behind, the rest of the callback is lost in the blocks it would have taken
+			n = (unsigned int)(raw_pool.block_size / (2 * sizeof(short)));
+			sample_queue_count_lost(&raw_queue, (numSamples + n - 1) / n, numSamples);
+			return;
+		}
+
+		n = (unsigned int)(raw->size / (2 * sizeof(short)));
+		if (n > numSamples) {
+			n = numSamples;
+		}
+
+		memcpy(RAW_I(raw), xi, n * sizeof(short));
+		memcpy(RAW_Q(raw), xq, n * sizeof(short));
+		raw->len = n * 2 * sizeof(short);
+		raw->samples = n;
+
+		xi += n;
+		xq += n;
+		numSamples -= n;
+
+		// the raw pool is no larger than the raw queue, so this always fits
+		sample_queue_push(&raw_queue, raw);
+		sample_queue_notify(&raw_queue);
+	}
+}
+
 void rxa_callback(short* xi, short* xq, sdrplay_api_StreamCbParamsT *params, unsigned int numSamples, unsigned int reset, void* cbContext)
 {
 	if(params->fsChanged != 0)
@@ -635,210 +1030,1065 @@ void rxa_callback(short* xi, short* xq, sdrplay_api_StreamCbParamsT *params, uns
 	}
 
 	if (!do_exit) {
-		unsigned int i;
-		struct llist *rpt = (struct llist*)malloc(sizeof(struct llist));
+		queue_samples(xi, xq, numSamples);
+	}
+}
 
-		if (sample_format == RSP_TCP_SAMPLE_FORMAT_UINT8)
-		{
-			rpt->data = (char*)malloc(2 * numSamples);
+void rxb_callback(short* xi, short* xq, sdrplay_api_StreamCbParamsT *params, unsigned int numSamples, unsigned int reset, void* cbContext)
+{
+	if (!do_exit) {
+		queue_samples(xi, xq, numSamples);
+	}
+}
 
-			// assemble the data
-			char *data;
-			data = rpt->data;
-			for (i = 0; i < numSamples; i++, xi++, xq++)
-			{
-				*(data++) = (unsigned char)(((*xi << sample_shift) >> 8) + 128);
-				*(data++) = (unsigned char)(((*xq << sample_shift) >> 8) + 128);
-			}
+// frame being filled by the conversion thread, and the age it is checked again at
+static struct sample_block *cur_frame = NULL;
+static struct timeval cur_frame_start;
+static long cur_frame_wait;
+
+static void flush_frame()
+{
+	if (cur_frame) {
+		enqueue_block(cur_frame);
+		cur_frame = NULL;
+	}
+}
 
-			rpt->len = 2 * numSamples;
+static long frame_age_us(struct timeval *now)
+{
+	return (now->tv_sec - cur_frame_start.tv_sec) * 1000000L + (now->tv_usec - cur_frame_start.tv_usec);
+}
+
+// samples of an incomplete group or block, held until the next raw block
+static short group_i[RSP_TCP_BFP_BLOCK_SAMPLES];
+static short group_q[RSP_TCP_BFP_BLOCK_SAMPLES];
+static unsigned int group_fill = 0;
+
+// written by the conversion thread, read for the console report
+static rice_stats_t rice_stats;
+
+// rate conversion done in software, taken over from the requested_ values when rate_changed is set, which is stored last with release
+static dsp_decimator_t decimator;
+static volatile unsigned int requested_decimation = 1;
+static volatile uint32_t requested_resample_in = 0;
+static volatile uint32_t requested_resample_out = 0;
+static volatile uint32_t requested_stream_rate = 0;
+static volatile int rate_changed = 1;
+static short decimated_i[DSP_CHUNK];
+static short decimated_q[DSP_CHUNK];
+
+// down-converter behind the rate conversion, and the rates before and after it
+static dsp_decimator_t ddc;
+static uint32_t ddc_rate = 0;
+static uint32_t stream_rate = 0;
+static uint32_t frame_rate = 0;
+static short ddc_i[DSP_CHUNK];
+static short ddc_q[DSP_CHUNK];
+
+// channelizer in place of the down-converter, and the channels in each frame
+static unsigned int channels = 0;
+static unsigned int channel_step = 0;
+static unsigned int frame_channels = 1;
+static short channel_i[CHAN_MAX_OUTPUT];
+static short channel_q[CHAN_MAX_OUTPUT];
+
+// spectrum of the output in place of the samples, and the FFT size of the frames, 0 for samples
+static spectrum_t spectrum;
+static unsigned int spectrum_size = 0;
+static rsp_tcp_spectrum_window_t spectrum_window = RSP_TCP_SPECTRUM_WINDOW_HANN;
+static unsigned int frame_spectrum_size = 0;
+
+// count is a multiple of the group size of the current format
+static void frame_convert(const short *xi, const short *xq, unsigned int count)
+{
+	unsigned int n, offset = 0;
+	unsigned int group_samples = convert_group_samples(sample_format);
+	unsigned int group_bytes = convert_group_bytes(sample_format);
+
+	// pack the converted samples back to back into the current frame,
+	// a raw block may end up split over two frames
+	while (offset < count) {
+		if (cur_frame == NULL) {
+			cur_frame = get_block();
+			if (cur_frame == NULL) {
+				// pool exhausted, sample_pool.dry tells the worker
+				sample_queue_count_lost(&sample_queue, 1, count - offset);
+				return;
+			}
+			cur_frame->samples = 0;
+			cur_frame->format = sample_format;
+			cur_frame->shift = sample_shift;
+			cur_frame->rate = frame_rate;
+			cur_frame->channels = frame_channels;
+			cur_frame->spectrum = 0;
+			gettimeofday(&cur_frame_start, NULL);
+			cur_frame_wait = frame_max_age;
 		}
-		else if (sample_format == RSP_TCP_SAMPLE_FORMAT_INT16)
-		{
-			rpt->data = (char*)malloc(4 * numSamples);
 
-			short *data;
-			data = (short*)rpt->data;
-			for (i = 0; i < numSamples; i++, xi++, xq++)
-			{
-				*(data++) = *xi;
-				*(data++) = *xq;
+		if (sample_format == RSP_TCP_SAMPLE_FORMAT_RICE16) {
+			// one block at a time, a frame with less room than the worst case is full
+			n = count - offset < RSP_TCP_RICE_BLOCK_SAMPLES ? count - offset : RSP_TCP_RICE_BLOCK_SAMPLES;
+			cur_frame->len += rice_encode(cur_frame->data + cur_frame->len, xi + offset, xq + offset, n, &rice_stats);
+			cur_frame->samples += n;
+			offset += n;
+
+			if (cur_frame->size - cur_frame->len < RICE_MAX_BLOCK_BYTES(RSP_TCP_RICE_BLOCK_SAMPLES)) {
+				flush_frame();
 			}
+			continue;
+		}
 
-			rpt->len = 4 * numSamples;
+		n = (unsigned int)((cur_frame->size - cur_frame->len) / group_bytes) * group_samples;
+		if (n > count - offset) {
+			n = count - offset;
 		}
 
-		rpt->next = NULL;
+		sample_converter(cur_frame->data + cur_frame->len, xi + offset, xq + offset, n);
+		cur_frame->len += n / group_samples * group_bytes;
+		cur_frame->samples += n;
+		offset += n;
 
-		pthread_mutex_lock(&ll_mutex);
+		if (cur_frame->size - cur_frame->len < group_bytes) {
+			flush_frame();
+		}
+	}
+}
 
-		if (ll_buffers == NULL) {
-			ll_buffers = rpt;
+/*
+ * Automatic 8-bit scaling on the peak of every block and the RMS averaged
+ * over about AUTO_SCALE_RMS_MS. A peak that would clip drops the shift to
+ * fit it at once when the RMS leaves less than AUTO_SCALE_CREST_BITS of
+ * headroom as well, that is when the signal itself got louder. Over a quieter signal the peak only drops it
+ * once blocks have kept clipping for AUTO_SCALE_CLIP_MS, so a lone spike
+ * clips instead of taking bits from everything else. The shift only goes
+ * up by one once the peak has left at least two bits unused and the RMS
+ * more than the crest bits for AUTO_SCALE_RAISE_MS, so a signal near a
+ * boundary does not make it flip back and forth.
+ */
+#define AUTO_SCALE_MAX_SHIFT 8
+#define AUTO_SCALE_RAISE_MS 500
+#define AUTO_SCALE_CLIP_MS 20
+#define AUTO_SCALE_CREST_BITS 2
+#define AUTO_SCALE_RMS_MS 100
+
+static int default_auto_scale = 0;
+static int auto_scale = 0;
+static volatile int requested_auto_scale = 0;
+static unsigned int auto_scale_quiet = 0;
+static unsigned int auto_scale_clipped = 0;
+
+// mean power of one component, below 0 until the first block
+static double auto_scale_power = -1;
+
+// new shift, a frame holds samples of one shift only
+static void change_sample_shift(int shift)
+{
+	flush_frame();
+	sample_shift = shift;
+	update_converter();
+	auto_scale_quiet = 0;
+	auto_scale_clipped = 0;
+
+	if (verbose) {
+		printf("sample shift %d\n", shift);
+	}
+}
+
+// samples of all channels in ms at the output rate
+static unsigned long long auto_scale_samples(unsigned int ms)
+{
+	return (unsigned long long)frame_rate * ms / 1000 * frame_channels;
+}
+
+// bit length of the RMS of one component after a block of n samples with the given power
+static int rms_bits(unsigned long long power, unsigned int n)
+{
+	double window = (double)auto_scale_samples(AUTO_SCALE_RMS_MS);
+	int bits = 0;
+
+	if (auto_scale_power < 0) {
+		auto_scale_power = power / (2.0 * n);
+	}
+	else {
+		auto_scale_power = (auto_scale_power * window + power / 2.0) / (window + n);
+	}
+
+	while (bits < 16 && (double)(1ULL << (2 * bits)) <= auto_scale_power) {
+		bits++;
+	}
+
+	return bits;
+}
+
+static void auto_scale_update(const short *xi, const short *xq, unsigned int n)
+{
+	int bits, rms, shift = sample_shift;
+
+	if (n == 0) {
+		return;
+	}
+	bits = convert_peak_bits(xi, xq, n);
+	rms = rms_bits(convert_power(xi, xq, n), n);
+
+	// the int16 result of the shift has to stay below 2^15
+	if (bits + shift > 15) {
+		auto_scale_quiet = 0;
+		auto_scale_clipped += n;
+		if (rms + shift > 15 - AUTO_SCALE_CREST_BITS || auto_scale_clipped >= auto_scale_samples(AUTO_SCALE_CLIP_MS)) {
+			shift = 15 - bits;
 		}
-		else {
-			struct llist *cur = ll_buffers;
-			int num_queued = 0;
+	}
+	else if (bits + shift < 14 && rms + shift < 15 - AUTO_SCALE_CREST_BITS) {
+		auto_scale_clipped = 0;
+		auto_scale_quiet += n;
+		if (auto_scale_quiet >= auto_scale_samples(AUTO_SCALE_RAISE_MS)) {
+			shift++;
+		}
+	}
+	else {
+		auto_scale_quiet = 0;
+		auto_scale_clipped = 0;
+	}
 
-			while (cur->next != NULL) {
-				cur = cur->next;
-				num_queued++;
-			}
+	if (shift > AUTO_SCALE_MAX_SHIFT) {
+		shift = AUTO_SCALE_MAX_SHIFT;
+	}
+	if (shift != sample_shift) {
+		change_sample_shift(shift);
+	}
+}
 
-			if (llbuf_num && llbuf_num == num_queued - 2) {
-				struct llist *curelem;
+// one spectrum frame, on its own so it goes out right away
+static void frame_spectrum_out(void)
+{
+	struct sample_block *blk;
+
+	flush_frame();
+	blk = get_block();
+	if (blk == NULL) {
+		sample_queue_count_lost(&sample_queue, 1, 0);
+		spectrum_frame(&spectrum, NULL, frame_rate);
+		return;
+	}
 
-				free(ll_buffers->data);
-				curelem = ll_buffers->next;
-				free(ll_buffers);
-				ll_buffers = curelem;
-			}
+	blk->samples = 0;
+	blk->format = sample_format;
+	blk->shift = sample_shift;
+	blk->rate = frame_rate;
+	blk->channels = frame_channels;
+	blk->spectrum = spectrum_size;
+	blk->len = spectrum_frame(&spectrum, blk->data, frame_rate);
+	enqueue_block(blk);
+}
 
-			cur->next = rpt;
-			//if (verbose) {
-			//	if (num_queued > global_numq)
-			//		printf("ll+, now %d\n", num_queued);
-			//	else if (num_queued < global_numq)
-			//		printf("ll-, now %d\n", num_queued);
-			//}
-			global_numq = num_queued;
+static void frame_spectrum(const short *xi, const short *xq, unsigned int left)
+{
+	unsigned int n;
+
+	while (left) {
+		n = spectrum_feed(&spectrum, xi, xq, left);
+		xi += n;
+		xq += n;
+		left -= n;
+		if (spectrum_due(&spectrum)) {
+			frame_spectrum_out();
 		}
-		pthread_cond_signal(&cond);
-		pthread_mutex_unlock(&ll_mutex);
 	}
 }
 
-void rxb_callback(short* xi, short* xq, sdrplay_api_StreamCbParamsT *params, unsigned int numSamples, unsigned int reset, void* cbContext)
+// samples at the output rate, whatever their number
+static void frame_output(const short *xi, const short *xq, unsigned int left)
 {
-	if (!do_exit) {
-		unsigned int i;
-		struct llist *rpt = (struct llist*)malloc(sizeof(struct llist));
-
-		if (sample_format == RSP_TCP_SAMPLE_FORMAT_UINT8) {
-			rpt->data = (char*)malloc(2 * numSamples);
-
-			// assemble the data
-			char *data;
-			data = rpt->data;
-			for (i = 0; i < numSamples; i++, xi++, xq++) {
-				*(data++) = (unsigned char)(((*xi << sample_shift) >> 8) + 128);
-				*(data++) = (unsigned char)(((*xq << sample_shift) >> 8) + 128);
-			}
+	unsigned int group_samples;
+
+	if (spectrum_size) {
+		frame_spectrum(xi, xq, left);
+		return;
+	}
 
-			rpt->len = 2 * numSamples;
+	if (auto_scale && sample_format == RSP_TCP_SAMPLE_FORMAT_UINT8) {
+		auto_scale_update(xi, xq, left);
+	}
+
+	// frames only ever hold whole groups, callbacks need not
+	group_samples = convert_group_samples(sample_format);
+	if (group_fill) {
+		while (group_fill < group_samples && left) {
+			group_i[group_fill] = *(xi++);
+			group_q[group_fill++] = *(xq++);
+			left--;
 		}
-		else
-			if (sample_format == RSP_TCP_SAMPLE_FORMAT_INT16) {
-				rpt->data = (char*)malloc(4 * numSamples);
-
-				short *data;
-				data = (short*)rpt->data;
-				for (i = 0; i < numSamples; i++, xi++, xq++) {
-					*(data++) = *xi;
-					*(data++) = *xq;
-				}
+		if (group_fill < group_samples) {
+			return;
+		}
+		frame_convert(group_i, group_q, group_samples);
+		group_fill = 0;
+	}
 
-				rpt->len = 4 * numSamples;
-			}
+	frame_convert(xi, xq, left - left % group_samples);
 
-		rpt->next = NULL;
+	xi += left - left % group_samples;
+	xq += left - left % group_samples;
+	for (left %= group_samples; left; left--) {
+		group_i[group_fill] = *(xi++);
+		group_q[group_fill++] = *(xq++);
+	}
+}
 
-		pthread_mutex_lock(&ll_mutex);
+// part of a group cannot be sent, it is lost when the format or rate changes
+static void drop_group(void)
+{
+	sample_queue_count_lost(&sample_queue, 0, group_fill);
+	group_fill = 0;
+}
+
+// a retune keeps the filters running, anything else starts them from silence
+static void update_ddc(int restart)
+{
+	int32_t offset = requested_ddc_offset;
+	uint32_t rate = requested_ddc_rate;
 
-		if (ll_buffers == NULL) {
-			ll_buffers = rpt;
+	if (rate && (restart || rate != ddc_rate)) {
+		if (dsp_ddc_init(&ddc, stream_rate, offset, rate)) {
+			printf("down-converter cannot make %u Hz from %u Hz\n", rate, stream_rate);
+			rate = 0;
+		}
+	}
+	else if (rate) {
+		dsp_ddc_set_offset(&ddc, stream_rate, offset);
+	}
+	ddc_rate = rate;
+}
+
+// a new channel count starts from silence, a new selection with the next output
+static void update_channels(int restart)
+{
+	unsigned int mask[CHAN_MASK_WORDS];
+	unsigned int i, count = requested_channels, step = requested_channel_step;
+
+	if (count && (restart || count != channels || step != channel_step)) {
+		if (chan_configure(count, step)) {
+			printf("channelizer cannot make %u channels\n", count);
+			count = 0;
+		}
+	}
+	if (count) {
+		for (i = 0; i < CHAN_MASK_WORDS; i++) {
+			mask[i] = requested_channel_mask[i];
+		}
+		chan_select(mask);
+	}
+	channels = count;
+	channel_step = step;
+}
+
+// a new FFT size or window starts from an empty frame
+static void update_spectrum(void)
+{
+	unsigned int size = requested_spectrum_size;
+	rsp_tcp_spectrum_window_t window = requested_spectrum_window;
+
+	if (size && (size != spectrum_size || window != spectrum_window)) {
+		if (spectrum_init(&spectrum, size, window)) {
+			printf("spectrum of %u points is not supported\n", size);
+			size = 0;
+		}
+	}
+	spectrum_size = size;
+	spectrum_window = window;
+}
+
+// a new rate or channel layout starts with a new frame, the tcp worker puts markers in front
+static void update_frame_layout(void)
+{
+	uint32_t rate = channels ? stream_rate / channel_step : ddc_rate ? ddc_rate : stream_rate;
+	unsigned int count = channels ? chan_selected() : 1;
+
+	if (rate != frame_rate || count != frame_channels || spectrum_size != frame_spectrum_size) {
+		flush_frame();
+		drop_group();
+		frame_rate = rate;
+		frame_channels = count;
+		frame_spectrum_size = spectrum_size;
+	}
+
+	// the frame timing follows the rate, so it starts over with every change
+	if (spectrum_size) {
+		spectrum_set_timing(&spectrum, frame_rate / requested_spectrum_rate, requested_spectrum_average);
+	}
+}
+
+// samples at the stream rate, through the down-converter when there is one
+static void frame_ddc(const short *xi, const short *xq, unsigned int count)
+{
+	unsigned int n, done;
+
+	if (!ddc_rate) {
+		frame_output(xi, xq, count);
+		return;
+	}
+
+	for (done = 0; done < count; done += n) {
+		n = count - done < DSP_CHUNK ? count - done : DSP_CHUNK;
+		frame_output(ddc_i, ddc_q, dsp_decimate(&ddc, xi + done, xq + done, n, ddc_i, ddc_q));
+	}
+}
+
+// samples at the stream rate into the channelizer, rows of the selected channels out
+static void frame_channels_out(const short *xi, const short *xq, unsigned int count)
+{
+	unsigned int n, done;
+
+	for (done = 0; done < count; done += n) {
+		n = count - done < CHAN_CHUNK ? count - done : CHAN_CHUNK;
+		frame_output(channel_i, channel_q, chan_run(xi + done, xq + done, n, channel_i, channel_q));
+	}
+}
+
+static void frame_stream(const short *xi, const short *xq, unsigned int count)
+{
+	if (channels) {
+		frame_channels_out(xi, xq, count);
+	}
+	else {
+		frame_ddc(xi, xq, count);
+	}
+}
+
+// the limits follow what goes out to the client, on the conversion thread whenever that changes
+static void update_queue_limits(void)
+{
+	size_t max_bytes = queue_max_bytes;
+	size_t limit_bytes;
+	double sample_size = output_sample_size();
+	double byte_rate = (double)frame_rate * frame_channels * sample_size;
+
+	if (spectrum_size) {
+		byte_rate = (double)requested_spectrum_rate * SPECTRUM_FRAME_BYTES(spectrum_size);
+	}
+	if (byte_rate == 0 || stream_rate == 0) {
+		return;
+	}
+
+	if (queue_max_ms) {
+		limit_bytes = (size_t)(byte_rate * queue_max_ms / 1000.0);
+		if (max_bytes == 0 || limit_bytes < max_bytes) {
+			max_bytes = limit_bytes;
+		}
+	}
+
+	// a buffer is RAW_BLOCK_SAMPLES at the client rate, what one callback used to queue
+	if (llbuf_num) {
+		limit_bytes = (size_t)(byte_rate * llbuf_num * RAW_BLOCK_SAMPLES / stream_rate);
+		if (max_bytes == 0 || limit_bytes < max_bytes) {
+			max_bytes = limit_bytes;
+		}
+	}
+
+	sample_queue_set_max_bytes(&sample_queue, max_bytes);
+
+	printf("sample queue limit %lu bytes (%.1f ms)\n", (unsigned long)max_bytes, max_bytes * 1000.0 / byte_rate);
+}
+
+// take over what the command thread asked for, between two raw blocks
+static void take_requests(void)
+{
+	int changed = 0, rate, output;
+
+	// a new format starts with a new frame, the tcp worker puts a marker in front
+	if (requested_sample_format != sample_format) {
+		flush_frame();
+		drop_group();
+		sample_format = requested_sample_format;
+		update_converter();
+		changed = 1;
+	}
+
+	if (requested_auto_scale != auto_scale) {
+		auto_scale = requested_auto_scale;
+		if (!auto_scale && sample_shift != DEFAULT_SAMPLE_SHIFT) {
+			change_sample_shift(DEFAULT_SAMPLE_SHIFT);
+		}
+	}
+
+	/*
+	 * The command thread writes the requested_ values and then sets the flag
+	 * with release. Taking the flag back with an acquire swap makes the
+	 * values written before it visible here, and a request set again while
+	 * this one is applied leaves the flag up for the next block.
+	 */
+	rate = ATOMIC_SWAP(&rate_changed, 0);
+	output = ATOMIC_SWAP(&output_changed, 0);
+
+	// a new rate starts the filters from silence
+	if (rate) {
+		dsp_decimator_init(&decimator, requested_decimation, requested_resample_in, requested_resample_out);
+		stream_rate = requested_stream_rate;
+		update_ddc(1);
+		update_channels(1);
+		update_spectrum();
+		update_frame_layout();
+		changed = 1;
+	}
+	else if (output) {
+		update_ddc(0);
+		update_channels(0);
+		update_spectrum();
+		update_frame_layout();
+		changed = 1;
+	}
+
+	if (changed) {
+		update_queue_limits();
+	}
+}
+
+static void frame_samples(const short *xi, const short *xq, unsigned int count)
+{
+	unsigned int n, done;
+
+	if (!dsp_decimator_active(&decimator)) {
+		frame_stream(xi, xq, count);
+		return;
+	}
+
+	for (done = 0; done < count; done += n) {
+		n = count - done < DSP_CHUNK ? count - done : DSP_CHUNK;
+		frame_stream(decimated_i, decimated_q, dsp_decimate(&decimator, xi + done, xq + done, n, decimated_i, decimated_q));
+	}
+}
+
+static void *convert_worker(void *arg)
+{
+	struct sample_block *raw;
+	struct timespec ts;
+	struct timeval tp;
+	long usec;
+
+	while (!do_exit) {
+		// sleep until the next callback, or until the open frame gets too old
+		if (cur_frame) {
+			tp = cur_frame_start;
+			usec = tp.tv_usec + cur_frame_wait;
 		}
 		else {
-			struct llist *cur = ll_buffers;
-			int num_queued = 0;
+			gettimeofday(&tp, NULL);
+			usec = tp.tv_usec + 1000000L;
+		}
+		ts.tv_sec = tp.tv_sec + usec / 1000000L;
+		ts.tv_nsec = (usec % 1000000L) * 1000;
+		sample_queue_wait(&raw_queue, &ts);
+
+		while ((raw = sample_queue_pop(&raw_queue)) != NULL) {
+			take_requests();
+			frame_samples(RAW_I(raw), RAW_Q(raw), raw->samples);
+			sample_pool_put(&raw_pool, raw);
+		}
 
-			while (cur->next != NULL) {
-				cur = cur->next;
-				num_queued++;
+		if (cur_frame) {
+			gettimeofday(&tp, NULL);
+			usec = frame_age_us(&tp);
+			if (usec >= cur_frame_wait) {
+				// a partial frame only goes in once the worker has caught up, until then
+				// it fills up, so the queue limits and the pool are taken by full frames
+				if (sample_queue_count(&sample_queue) == 0) {
+					flush_frame();
+				}
+				else {
+					cur_frame_wait = usec + FRAME_RECHECK_US;
+				}
 			}
+		}
+	}
+
+	if (cur_frame) {
+		sample_pool_put(&sample_pool, cur_frame);
+		cur_frame = NULL;
+	}
+	group_fill = 0;
+
+	pthread_exit(NULL);
+	return NULL;
+}
+
+#define RICE_REPORT_SEC 10
+
+static rice_stats_t reported_rice;
+static time_t rice_report_time = 0;
+
+// compression ratio and encoder time since the last report
+static void report_rice_stats(int final)
+{
+	unsigned long long samples = rice_stats.samples - reported_rice.samples;
+	unsigned long long bytes = rice_stats.bytes - reported_rice.bytes;
+	unsigned long long ns = rice_stats.ns - reported_rice.ns;
+	time_t now = time(NULL);
+
+	if (rice_report_time == 0) {
+		rice_report_time = now;
+	}
+	if (samples == 0 || (!final && now - rice_report_time < RICE_REPORT_SEC)) {
+		return;
+	}
+
+	printf("lossless: ratio %.3f (%.2f bits/sample), %.2f ns/sample, %llu escapes\n",
+		(double)samples * 2 * sizeof(short) / bytes, (double)bytes * 8 / samples,
+		(double)ns / samples, rice_stats.escapes - reported_rice.escapes);
+
+	reported_rice = rice_stats;
+	rice_report_time = now;
+}
+
+static unsigned int reported_pool_dry = 0;
+
+// drops of a queue in the current session, the queue counters are only ever read as differences
+typedef struct {
+	unsigned int blocks;
+	unsigned int samples;
+	unsigned long long total_blocks;
+	unsigned long long total_samples;
+} drop_report_t;
+
+static drop_report_t sample_drops;
+static drop_report_t raw_drops;
+
+// adds the drops since the last call, returns 1 when there were any
+static int update_drops(sample_queue_t *q, drop_report_t *r)
+{
+	unsigned int blocks = q->dropped_blocks;
+	unsigned int samples = q->dropped_samples;
+
+	if (blocks == r->blocks && samples == r->samples) {
+		return 0;
+	}
 
-			if (llbuf_num && llbuf_num == num_queued - 2) {
-				struct llist *curelem;
+	r->total_blocks += blocks - r->blocks;
+	r->total_samples += samples - r->samples;
+	r->blocks = blocks;
+	r->samples = samples;
+	return 1;
+}
+
+static void report_queue_stats()
+{
+	unsigned int dry = sample_pool.dry;
+
+	if (dry != reported_pool_dry) {
+		reported_pool_dry = dry;
+		printf("sample pool ran dry (%u times)\n", dry);
+	}
+
+	if (update_drops(&sample_queue, &sample_drops)) {
+		printf("sample queue overflow, dropped %llu samples in %llu blocks\n", sample_drops.total_samples, sample_drops.total_blocks);
+	}
+
+	if (update_drops(&raw_queue, &raw_drops)) {
+		printf("conversion stage overflow, dropped %llu samples in %llu blocks\n", raw_drops.total_samples, raw_drops.total_blocks);
+	}
+
+	report_rice_stats(0);
+}
+
+// max number of queued blocks handed to the kernel in one send call
+#define TCP_MAX_IOV 64
+
+#ifdef _WIN32
+typedef WSABUF tcp_iovec_t;
+#define IOV_BASE(v) ((v).buf)
+#define IOV_LEN(v) ((v).len)
+#else
+typedef struct iovec tcp_iovec_t;
+#define IOV_BASE(v) ((v).iov_base)
+#define IOV_LEN(v) ((v).iov_len)
+#endif
+
+/*
+ * Optional Linux MSG_ZEROCOPY transmit (-Z).
+ *
+ * The kernel keeps referencing the frame pages after sendmsg() returns, so a
+ * frame that went out only goes back to the pool once the completion for the
+ * last send call that touched it has been read from the socket error queue.
+ * Every zero-copy send call gets the next sequence number, completions report
+ * ranges of them, possibly out of order.
+ */
+#define ZEROCOPY_WINDOW 1024
+
+#ifdef HAVE_ZEROCOPY
+static int zerocopy_active = 0;
+static struct sample_block *zc_blocks[ZEROCOPY_MAX_PENDING];
+static uint32_t zc_ids[ZEROCOPY_MAX_PENDING];
+static unsigned int zc_head = 0, zc_tail = 0;
+static uint32_t zc_next_id = 0;
+static uint32_t zc_done = 0;
+static unsigned char zc_completed[ZEROCOPY_WINDOW];
+static unsigned int zc_completions = 0, zc_copied = 0;
+#endif
+
+static void zerocopy_enable(SOCKET sock)
+{
+#ifdef HAVE_ZEROCOPY
+	int one = 1;
+
+	zc_next_id = 0;
+	zc_done = 0;
+	zc_completions = 0;
+	zc_copied = 0;
+	memset(zc_completed, 0, sizeof(zc_completed));
+	zerocopy_active = 0;
+
+	if (!zerocopy) {
+		return;
+	}
+
+	if (setsockopt(sock, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one)) != 0) {
+		printf("zero-copy send not supported (%s), using copies\n", strerror(errno));
+		return;
+	}
+
+	zerocopy_active = 1;
+#else
+	if (zerocopy) {
+		printf("zero-copy send not supported on this platform, using copies\n");
+	}
+#endif
+}
+
+static unsigned int zerocopy_pending()
+{
+#ifdef HAVE_ZEROCOPY
+	return zc_head - zc_tail;
+#else
+	return 0;
+#endif
+}
+
+// number of frames that can be handed to the kernel right now
+static int zerocopy_room()
+{
+#ifdef HAVE_ZEROCOPY
+	if (zerocopy_active || zerocopy_pending()) {
+		return ZEROCOPY_MAX_PENDING - zerocopy_pending();
+	}
+#endif
+	return TCP_MAX_IOV;
+}
 
-				free(ll_buffers->data);
-				curelem = ll_buffers->next;
-				free(ll_buffers);
-				ll_buffers = curelem;
+// called for every frame that has been completely handed to the kernel
+static void zerocopy_release(struct sample_block *blk)
+{
+	if (blk == NULL) {
+		// stream marker, not a pool block
+		return;
+	}
+
+#ifdef HAVE_ZEROCOPY
+	if (zerocopy_active || zerocopy_pending()) {
+		// wait for the last zero-copy call issued so far
+		zc_blocks[zc_head % ZEROCOPY_MAX_PENDING] = blk;
+		zc_ids[zc_head % ZEROCOPY_MAX_PENDING] = zc_next_id - 1;
+		zc_head++;
+		return;
+	}
+#endif
+	sample_pool_put(&sample_pool, blk);
+}
+
+// read the completion notifications, waiting up to timeout_ms for the first
+static void zerocopy_reap(SOCKET sock, int timeout_ms)
+{
+#ifdef HAVE_ZEROCOPY
+	char control[128];
+	struct msghdr msg;
+	struct cmsghdr *cm;
+	struct sock_extended_err *serr;
+	struct pollfd pfd;
+	uint32_t id;
+
+	if (zc_next_id == zc_done) {
+		return;
+	}
+
+	if (timeout_ms > 0) {
+		pfd.fd = sock;
+		pfd.events = 0;
+		pfd.revents = 0;
+		poll(&pfd, 1, timeout_ms);
+	}
+
+	while (1) {
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_control = control;
+		msg.msg_controllen = sizeof(control);
+		if (recvmsg(sock, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) {
+			break;
+		}
+
+		for (cm = CMSG_FIRSTHDR(&msg); cm != NULL; cm = CMSG_NXTHDR(&msg, cm)) {
+			serr = (struct sock_extended_err *)CMSG_DATA(cm);
+			if (serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY || serr->ee_errno != 0) {
+				continue;
 			}
 
-			cur->next = rpt;
-			if (verbose) {
-				if (num_queued > global_numq)
-					printf("ll+, now %d\n", num_queued);
-				else if (num_queued < global_numq)
-					printf("ll-, now %d\n", num_queued);
+			for (id = serr->ee_info; (int32_t)(id - serr->ee_data) <= 0; id++) {
+				zc_completed[id % ZEROCOPY_WINDOW] = 1;
+				zc_completions++;
+				if (serr->ee_code & SO_EE_CODE_ZEROCOPY_COPIED) {
+					zc_copied++;
+				}
 			}
-			global_numq = num_queued;
 		}
-		pthread_cond_signal(&cond);
-		pthread_mutex_unlock(&ll_mutex);
 	}
+
+	while (zc_done != zc_next_id && zc_completed[zc_done % ZEROCOPY_WINDOW]) {
+		zc_completed[zc_done % ZEROCOPY_WINDOW] = 0;
+		zc_done++;
+	}
+
+	while (zc_tail != zc_head && (int32_t)(zc_ids[zc_tail % ZEROCOPY_MAX_PENDING] - zc_done) < 0) {
+		sample_pool_put(&sample_pool, zc_blocks[zc_tail % ZEROCOPY_MAX_PENDING]);
+		zc_tail++;
+	}
+
+	// e.g. loopback or a device without scatter-gather: the kernel copies anyway
+	if (zerocopy_active && zc_completions >= 256 && zc_copied == zc_completions) {
+		printf("kernel copies zero-copy sends to this client, using plain sends\n");
+		zerocopy_active = 0;
+	}
+#endif
+}
+
+// hand the frames back to the pool once the connection is gone
+static void zerocopy_drop_pending()
+{
+#ifdef HAVE_ZEROCOPY
+	while (zc_tail != zc_head) {
+		sample_pool_put(&sample_pool, zc_blocks[zc_tail % ZEROCOPY_MAX_PENDING]);
+		zc_tail++;
+	}
+	zerocopy_active = 0;
+#endif
+}
+
+static long send_iov(SOCKET sock, tcp_iovec_t *iov, int count)
+{
+#ifdef _WIN32
+	DWORD sent = 0;
+
+	if (WSASend(sock, iov, count, &sent, 0, NULL, NULL) == SOCKET_ERROR) {
+		return SOCKET_ERROR;
+	}
+	return (long)sent;
+#else
+	struct msghdr msg;
+	ssize_t r;
+
+#ifdef HAVE_LIBURING
+	if (uring_active) {
+		return tcp_uring_send(sock, iov, count);
+	}
+#endif
+
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = iov;
+	msg.msg_iovlen = count;
+
+#ifdef HAVE_ZEROCOPY
+	if (zerocopy_active) {
+		r = sendmsg(sock, &msg, MSG_ZEROCOPY);
+		if (r >= 0) {
+			zc_next_id++;
+			return (long)r;
+		}
+		// out of pinned page budget, copy this one
+		if (errno != ENOBUFS) {
+			return SOCKET_ERROR;
+		}
+	}
+#endif
+	r = sendmsg(sock, &msg, 0);
+	return (long)r;
+#endif
+}
+
+// markers stay valid while the kernel may still reference them (zero-copy)
+static rsp_tcp_marker_t stream_markers[5 * TCP_MAX_IOV];
+static unsigned int stream_marker_index = 0;
+
+static rsp_tcp_marker_t *next_marker(unsigned int type, unsigned int value)
+{
+	rsp_tcp_marker_t *marker = &stream_markers[stream_marker_index++ % (5 * TCP_MAX_IOV)];
+
+	memcpy(marker->magic, RSP_TCP_MARKER_MAGIC, 4);
+	marker->type = htonl(type);
+	marker->value = htonl(value);
+	marker->check = htonl(~(type ^ value));
+
+	return marker;
 }
 
 static void *tcp_worker(void *arg)
 {
-	struct llist *curelem, *prev;
-	int bytesleft, bytessent, index;
+	// room for five markers in front of every block
+	struct sample_block *blocks[6 * TCP_MAX_IOV];
+	tcp_iovec_t iov[6 * TCP_MAX_IOV];
+	struct sample_block *curelem;
+	unsigned int wire_format = sample_format;
+	int wire_shift = -1;
+	unsigned int wire_rate = 0;
+	unsigned int wire_channels = 0;
+	unsigned int wire_spectrum = 0;
+	int count, popped, max_count, first;
+	long bytessent, advance;
+#ifndef HAVE_EPOLL
 	struct timeval tv = { 1,0 };
 	struct timespec ts;
-	struct timeval tp;
 	fd_set writefds;
+#endif
+	struct timeval tp;
+	int timeout_ms;
 	int r = 0;
+	time_t last_report = 0;
+
+	while (1) {
+		if (do_exit) {
+			pthread_exit(0);
+		}
+
+		gettimeofday(&tp, NULL);
+		if (tp.tv_sec != last_report) {
+			last_report = tp.tv_sec;
+			report_queue_stats();
+		}
+
+		// frames held by the kernel only come back when the completions are read
+		timeout_ms = WORKER_TIMEOUT_SEC * 1000;
+		if (zerocopy_pending()) {
+			zerocopy_reap(s, 0);
+			if (zerocopy_pending()) {
+				timeout_ms = 10;
+			}
+		}
 
-	while (1) {
+#ifdef HAVE_EPOLL
+		r = wait_samples(timeout_ms);
 		if (do_exit) {
 			pthread_exit(0);
 		}
-
-		pthread_mutex_lock(&ll_mutex);
-		gettimeofday(&tp, NULL);
-		ts.tv_sec = tp.tv_sec + WORKER_TIMEOUT_SEC;
-		ts.tv_nsec = tp.tv_usec * 1000;
-		r = pthread_cond_timedwait(&cond, &ll_mutex, &ts);
-		if (r == ETIMEDOUT) {
-			pthread_mutex_unlock(&ll_mutex);
+#else
+		tp.tv_usec += (timeout_ms % 1000) * 1000;
+		ts.tv_sec = tp.tv_sec + timeout_ms / 1000 + tp.tv_usec / 1000000;
+		ts.tv_nsec = (tp.tv_usec % 1000000) * 1000;
+		r = sample_queue_wait(&sample_queue, &ts);
+#endif
+		if (r == ETIMEDOUT && zerocopy_pending()) {
+			continue;
+		}
+		else if (r == ETIMEDOUT) {
 			printf("worker cond timeout\n");
 			sighandler(CTRL_CLOSE_EVENT);
 			pthread_exit(NULL);
 		}
 
-		curelem = ll_buffers;
-		ll_buffers = 0;
-		pthread_mutex_unlock(&ll_mutex);
+		while (sample_queue_count(&sample_queue)) {
+			// keep the number of frames owned by the kernel bounded
+			while ((max_count = zerocopy_room()) == 0 && !do_exit) {
+				zerocopy_reap(s, 100);
+			}
+			if (max_count == 0) {
+				break;
+			}
+			if (max_count > TCP_MAX_IOV) {
+				max_count = TCP_MAX_IOV;
+			}
+
+			// gather everything pending and send it with a single call
+			for (count = 0, popped = 0; popped < max_count && (curelem = sample_queue_pop(&sample_queue)) != NULL; popped++) {
+				if (curelem->format != wire_format) {
+					wire_format = curelem->format;
+					blocks[count] = NULL;
+					IOV_BASE(iov[count]) = (char *)next_marker(RSP_TCP_MARKER_SAMPLE_FORMAT, wire_format);
+					IOV_LEN(iov[count]) = sizeof(rsp_tcp_marker_t);
+					count++;
+				}
+				if (shift_markers && curelem->format == RSP_TCP_SAMPLE_FORMAT_UINT8 && curelem->shift != wire_shift) {
+					wire_shift = curelem->shift;
+					blocks[count] = NULL;
+					IOV_BASE(iov[count]) = (char *)next_marker(RSP_TCP_MARKER_SAMPLE_SHIFT, (unsigned int)wire_shift);
+					IOV_LEN(iov[count]) = sizeof(rsp_tcp_marker_t);
+					count++;
+				}
+				if (rate_markers && curelem->rate != wire_rate) {
+					wire_rate = curelem->rate;
+					blocks[count] = NULL;
+					IOV_BASE(iov[count]) = (char *)next_marker(RSP_TCP_MARKER_SAMPLE_RATE, wire_rate);
+					IOV_LEN(iov[count]) = sizeof(rsp_tcp_marker_t);
+					count++;
+				}
+				if (channel_markers && curelem->channels != wire_channels) {
+					wire_channels = curelem->channels;
+					blocks[count] = NULL;
+					IOV_BASE(iov[count]) = (char *)next_marker(RSP_TCP_MARKER_CHANNELS, wire_channels);
+					IOV_LEN(iov[count]) = sizeof(rsp_tcp_marker_t);
+					count++;
+				}
+				if (curelem->spectrum != wire_spectrum) {
+					wire_spectrum = curelem->spectrum;
+					blocks[count] = NULL;
+					IOV_BASE(iov[count]) = (char *)next_marker(RSP_TCP_MARKER_SPECTRUM, wire_spectrum);
+					IOV_LEN(iov[count]) = sizeof(rsp_tcp_marker_t);
+					count++;
+				}
+				blocks[count] = curelem;
+				IOV_BASE(iov[count]) = curelem->data;
+				IOV_LEN(iov[count]) = curelem->len;
+				count++;
+			}
 
-		while (curelem != 0) {
-			bytesleft = curelem->len;
-			index = 0;
+			first = 0;
 			bytessent = 0;
-			while (bytesleft > 0) {
+			while (first < count) {
+#ifdef HAVE_EPOLL
+				// non-blocking socket: only sleep once the kernel buffer is full
+				bytessent = send_iov(s, &iov[first], count - first);
+				if (bytessent == SOCKET_ERROR && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+					wait_epoll(send_epoll, 1000);
+					bytessent = 0;
+				}
+#else
 				FD_ZERO(&writefds);
 				FD_SET(s, &writefds);
 				tv.tv_sec = 1;
 				tv.tv_usec = 0;
 				r = select(s + 1, NULL, &writefds, NULL, &tv);
-				if (r) {
-					bytessent = send(s, &curelem->data[index], bytesleft, 0);
-					bytesleft -= bytessent;
-					index += bytessent;
-				}
+				bytessent = r ? send_iov(s, &iov[first], count - first) : 0;
+#endif
 				if (bytessent == SOCKET_ERROR || do_exit) {
 #ifdef _WIN32
 					printf("worker socket bye (%d), do_exit:%d\n", WSAGetLastError(), do_exit);
 #else
 					printf("worker socket bye, do_exit:%d\n", do_exit);
 #endif
+					for (; first < count; first++) {
+						if (blocks[first]) {
+							sample_pool_put(&sample_pool, blocks[first]);
+						}
+					}
 					sighandler(CTRL_CLOSE_EVENT);
 					pthread_exit(NULL);
 				}
+
+				// release the blocks that went out, then skip into a partly sent one
+				advance = bytessent;
+				while (first < count && (size_t)advance >= IOV_LEN(iov[first])) {
+					advance -= (long)IOV_LEN(iov[first]);
+					zerocopy_release(blocks[first++]);
+				}
+				if (first < count && advance > 0) {
+					IOV_BASE(iov[first]) = (char *)IOV_BASE(iov[first]) + advance;
+					IOV_LEN(iov[first]) -= advance;
+				}
+				zerocopy_reap(s, 0);
 			}
-			prev = curelem;
-			curelem = curelem->next;
-			free(prev->data);
-			free(prev);
 		}
 	}
 }
@@ -1169,6 +2419,145 @@ static int set_bias_t(unsigned int enable)
 	return 0;
 }
 
+static int set_sample_format(unsigned int format)
+{
+	if (format >= 32 || (SUPPORTED_SAMPLE_FORMATS & RSP_TCP_SAMPLE_FORMAT_BIT(format)) == 0) {
+		printf("sample format %u is not supported\n", format);
+		return -1;
+	}
+
+	// the conversion thread switches at the next block
+	requested_sample_format = (rsp_tcp_sample_format_t)format;
+	return 0;
+}
+
+static int set_auto_scale(unsigned int enable)
+{
+	// from now on the client gets the shift in the stream, starting with the current one
+	shift_markers = 1;
+	requested_auto_scale = enable != 0;
+	return 0;
+}
+
+static int set_ddc(int32_t offset, uint32_t rate)
+{
+	if (rate && !dsp_ddc_supported(current_samp_rate, offset, rate)) {
+		printf("down-converter at %d Hz with %u Hz is not supported at %u Hz\n", offset, rate, current_samp_rate);
+		return -1;
+	}
+
+	// from now on the client gets the rate in the stream, starting with the current one
+	rate_markers = 1;
+
+	// the channelizer and the down-converter take turns
+	if (rate) {
+		requested_channels = 0;
+	}
+
+	requested_ddc_offset = offset;
+	requested_ddc_rate = rate;
+	ATOMIC_STORE(&output_changed, 1);
+	return 0;
+}
+
+static int set_channelizer(unsigned int param)
+{
+	unsigned int i, count = param & ~RSP_TCP_CHANNELIZER_OVERSAMPLE;
+
+	if (count && (count < 2 || count > DSP_MAX_CHANNELS || (count & (count - 1)) != 0)) {
+		printf("channelizer with %u channels is not supported\n", count);
+		return -1;
+	}
+
+	// from now on the client gets the rate and channel count in the stream
+	rate_markers = 1;
+	channel_markers = 1;
+
+	if (count) {
+		requested_ddc_rate = 0;
+		requested_spectrum_size = 0;
+	}
+
+	for (i = 0; i < CHAN_MASK_WORDS; i++) {
+		requested_channel_mask[i] = 0xffffffff;
+	}
+	requested_channel_step = param & RSP_TCP_CHANNELIZER_OVERSAMPLE ? count / 2 : count;
+	requested_channels = count;
+	ATOMIC_STORE(&output_changed, 1);
+	return 0;
+}
+
+static int select_channel(unsigned int param)
+{
+	unsigned int c = param & ~RSP_TCP_CHANNEL_SELECTED;
+
+	if (c >= requested_channels) {
+		printf("channel %u is not there\n", c);
+		return -1;
+	}
+
+	if (param & RSP_TCP_CHANNEL_SELECTED) {
+		requested_channel_mask[c / 32] |= 1u << (c % 32);
+	}
+	else {
+		requested_channel_mask[c / 32] &= ~(1u << (c % 32));
+	}
+	ATOMIC_STORE(&output_changed, 1);
+	return 0;
+}
+
+static int set_spectrum(unsigned int size)
+{
+	if (size && (size < RSP_TCP_SPECTRUM_MIN_SIZE || size > RSP_TCP_SPECTRUM_MAX_SIZE || (size & (size - 1)) != 0)) {
+		printf("spectrum of %u points is not supported\n", size);
+		return -1;
+	}
+	if (SPECTRUM_FRAME_BYTES(size) > frame_bytes) {
+		printf("spectrum of %u points does not fit in a frame of %lu bytes\n", size, (unsigned long)frame_bytes);
+		return -1;
+	}
+
+	// the spectrum is taken behind the down-converter, the channelizer has no single spectrum
+	if (size) {
+		requested_channels = 0;
+	}
+
+	requested_spectrum_size = size;
+	ATOMIC_STORE(&output_changed, 1);
+	return 0;
+}
+
+static int set_spectrum_window(unsigned int window)
+{
+	if (window > RSP_TCP_SPECTRUM_WINDOW_BLACKMAN_HARRIS) {
+		printf("spectrum window %u is not supported\n", window);
+		return -1;
+	}
+
+	requested_spectrum_window = (rsp_tcp_spectrum_window_t)window;
+	ATOMIC_STORE(&output_changed, 1);
+	return 0;
+}
+
+static int set_spectrum_average(unsigned int average)
+{
+	requested_spectrum_average = average;
+	ATOMIC_STORE(&output_changed, 1);
+	return 0;
+}
+
+static int set_spectrum_rate(unsigned int rate)
+{
+	if (rate < 1 || rate > RSP_TCP_SPECTRUM_MAX_RATE) {
+		printf("spectrum rate %u is not supported\n", rate);
+		return -1;
+	}
+
+	requested_spectrum_rate = rate;
+	ATOMIC_STORE(&output_changed, 1);
+	return 0;
+}
+
 static int set_refclock_output(unsigned int enable)
 {
 	int r;
@@ -1667,29 +3056,96 @@ static int set_freq(uint32_t f)
 	return r;
 }
 
+/*
+ * Decimation left to the conversion thread for rates the hardware cannot
+ * decimate down to. The smallest factor that brings the device rate up to
+ * 2 MHz keeps the USB and callback load lowest; its power of two part goes to
+ * half-band stages and the rest to the FIR, which has a limit on its factor.
+ */
+static unsigned int software_decimation(uint32_t sr)
+{
+	uint32_t hw_rate = sr * MAX_DECIMATION_FACTOR;
+	unsigned int factor, odd;
+
+	if (hw_rate >= 2000000) {
+		return 1;
+	}
+
+	for (factor = (2000000 + hw_rate - 1) / hw_rate; ; factor++) {
+		for (odd = factor; odd % 2 == 0; odd /= 2);
+		if (odd <= DSP_MAX_FIR_DECIMATION) {
+			return factor;
+		}
+	}
+}
+
+/*
+ * Device rate and hardware decimation for a client rate, the rest is handed
+ * to the conversion thread. With a native rate the device stays there:
+ * hardware and half-band decimation bring it to less than twice the client
+ * rate and the resampler does the last step, so any rate comes out exactly.
+ */
+static double plan_sample_rate(uint32_t sr, int *decimation)
+{
+	unsigned int soft = 1;
+	uint32_t in_rate = 0, out_rate = 0;
+	double fs;
+
+	*decimation = 1;
+	if (native_samp_rate && sr < native_samp_rate) {
+		while (*decimation < MAX_DECIMATION_FACTOR && native_samp_rate / (2.0 * *decimation) >= sr) {
+			*decimation *= 2;
+		}
+		while (native_samp_rate / (2.0 * *decimation * soft) >= sr) {
+			soft *= 2;
+		}
+		fs = native_samp_rate;
+		in_rate = native_samp_rate;
+		out_rate = sr * *decimation * soft;
+	}
+	else {
+		soft = software_decimation(sr);
+		while (sr * soft * *decimation < 2000000 && *decimation < MAX_DECIMATION_FACTOR) {
+			*decimation *= 2;
+		}
+		fs = (double)sr * soft * *decimation;
+	}
+
+	if (soft > 1) {
+		printf("software decimation %u\n", soft);
+	}
+	if (in_rate != out_rate) {
+		printf("resampling %.2f to %u Hz\n", fs / (*decimation * soft), sr);
+	}
+
+	// the down-converter has to fit into the new rate
+	if (requested_ddc_rate && !dsp_ddc_supported(sr, requested_ddc_offset, requested_ddc_rate)) {
+		printf("down-converter off\n");
+		requested_ddc_rate = 0;
+	}
+
+	requested_decimation = soft;
+	requested_resample_in = in_rate;
+	requested_resample_out = out_rate;
+	requested_stream_rate = sr;
+	ATOMIC_STORE(&rate_changed, 1);
+
+	return fs;
+}
+
 static int set_sample_rate(uint32_t sr)
 {
 	int r;
 	double f;
 	int decimation;
 
-	if (sr < (2000000 / MAX_DECIMATION_FACTOR) || sr > 10000000) {
+	if (sr < MIN_SAMPLERATE || sr > MAX_SAMPLERATE) {
 		printf("sample rate %u is not supported\n", sr);
 		return -1;
 	}
 
-	decimation = 1;
 	if (sr < 2000000)
 	{
-		int c = 0;
-
-		// Find best decimation factor
-		while (sr * (1 << c) < 2000000 && (1 << c) < MAX_DECIMATION_FACTOR) {
-			c++;
-		}
-
-		decimation = 1 << c;
-
 		if (sr >= 1536000 && sr <= 2000000)
 		{
 			bwType = sdrplay_api_BW_1_536;
@@ -1736,7 +3192,7 @@ static int set_sample_rate(uint32_t sr)
 		}
 	}
 
-	f = (double)(sr * decimation);
+	f = plan_sample_rate(sr, &decimation);
 
 	if (decimation == 1) {
 		chParams->ctrlParams.decimation.enable = 0;
@@ -1777,6 +3233,8 @@ static int set_sample_rate(uint32_t sr)
 		printf("Sample rate not changed after %.1f seconds\n", (timeout / 1000.0));
 	}
 
+	current_samp_rate = sr;
+
 	r = sdrplay_api_Update(chosenDev->dev, chosenDev->tuner, sdrplay_api_Update_Tuner_BwType, sdrplay_api_Update_Ext1_None);
 
 	if (r != sdrplay_api_Success) {
@@ -1803,15 +3261,32 @@ struct command {
 static void *command_worker(void *arg)
 {
 	int left, received = 0;
-	fd_set readfds;
 	struct command cmd = { 0, 0 };
+#ifndef HAVE_EPOLL
+	fd_set readfds;
 	struct timeval tv = { 1, 0 };
 	int r = 0;
+#endif
 	uint32_t tmp;
 
 	while (1) {
 		left = sizeof(cmd);
 		while (left > 0) {
+#ifdef HAVE_EPOLL
+			// edge triggered, so read until the socket runs dry before sleeping
+			received = recv(s, (char*)&cmd + (sizeof(cmd) - left), left, 0);
+			if (received == SOCKET_ERROR && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+				wait_epoll(command_epoll, 1000);
+				received = 0;
+			}
+			else if (received == 0) {
+				// orderly shutdown by the client
+				received = SOCKET_ERROR;
+			}
+			else if (received > 0) {
+				left -= received;
+			}
+#else
 			FD_ZERO(&readfds);
 			FD_SET(s, &readfds);
 			tv.tv_sec = 1;
@@ -1821,6 +3296,7 @@ static void *command_worker(void *arg)
 				received = recv(s, (char*)&cmd + (sizeof(cmd) - left), left, 0);
 				left -= received;
 			}
+#endif
 			if (received == SOCKET_ERROR || do_exit) {
 #ifdef _WIN32
 				printf("comm recv bye (%d), do_exit:%d\n", WSAGetLastError(), do_exit);
@@ -1940,6 +3416,76 @@ static void *command_worker(void *arg)
 			}
 			break;
 
+		case RSP_TCP_COMMAND_SET_SAMPLE_FORMAT:
+			if (extended_mode) {
+				printf("set sample format %d\n", ntohl(cmd.param));
+				set_sample_format((unsigned int)ntohl(cmd.param));
+			}
+			break;
+
+		case RSP_TCP_COMMAND_SET_AUTO_SCALE:
+			if (extended_mode) {
+				printf("set auto scale %d\n", ntohl(cmd.param));
+				set_auto_scale((unsigned int)ntohl(cmd.param));
+			}
+			break;
+
+		case RSP_TCP_COMMAND_SET_DDC_OFFSET:
+			if (extended_mode) {
+				printf("set ddc offset %d\n", (int32_t)ntohl(cmd.param));
+				set_ddc((int32_t)ntohl(cmd.param), requested_ddc_rate);
+			}
+			break;
+
+		case RSP_TCP_COMMAND_SET_DDC_RATE:
+			if (extended_mode) {
+				printf("set ddc rate %u\n", ntohl(cmd.param));
+				set_ddc(requested_ddc_offset, ntohl(cmd.param));
+			}
+			break;
+
+		case RSP_TCP_COMMAND_SET_CHANNELIZER:
+			if (extended_mode) {
+				printf("set channelizer 0x%x\n", ntohl(cmd.param));
+				set_channelizer(ntohl(cmd.param));
+			}
+			break;
+
+		case RSP_TCP_COMMAND_SELECT_CHANNEL:
+			if (extended_mode) {
+				printf("select channel 0x%x\n", ntohl(cmd.param));
+				select_channel(ntohl(cmd.param));
+			}
+			break;
+
+		case RSP_TCP_COMMAND_SET_SPECTRUM:
+			if (extended_mode) {
+				printf("set spectrum %u\n", ntohl(cmd.param));
+				set_spectrum(ntohl(cmd.param));
+			}
+			break;
+
+		case RSP_TCP_COMMAND_SET_SPECTRUM_WINDOW:
+			if (extended_mode) {
+				printf("set spectrum window %u\n", ntohl(cmd.param));
+				set_spectrum_window(ntohl(cmd.param));
+			}
+			break;
+
+		case RSP_TCP_COMMAND_SET_SPECTRUM_AVERAGE:
+			if (extended_mode) {
+				printf("set spectrum average %u\n", ntohl(cmd.param));
+				set_spectrum_average(ntohl(cmd.param));
+			}
+			break;
+
+		case RSP_TCP_COMMAND_SET_SPECTRUM_RATE:
+			if (extended_mode) {
+				printf("set spectrum rate %u\n", ntohl(cmd.param));
+				set_spectrum_rate(ntohl(cmd.param));
+			}
+			break;
+
 		default:
 			break;
 		}
@@ -1952,6 +3498,8 @@ int init_rsp_device(unsigned int sr, unsigned int freq, int enable_bias_t, unsig
 	int r, dec;
 	uint8_t ifgain, lnastate;
 
+	current_samp_rate = sr;
+
 	// initialise frequency state
 	current_band = frequency_to_band(freq);
 	current_frequency = freq;
@@ -1971,15 +3519,7 @@ int init_rsp_device(unsigned int sr, unsigned int freq, int enable_bias_t, unsig
 	else if (sr < 8e6) { bwType = sdrplay_api_BW_7_000; }
 	else { bwType = sdrplay_api_BW_8_000; }
 	
-	dec = 1;
-	if (sr < 2e6)
-	{
-		while (sr < 2e6)
-		{
-			sr = sr * 2;
-			dec = dec * 2;
-		}
-	}
+	sr = (unsigned int)plan_sample_rate(sr, &dec);
 
 	if (chosenDev->hwVer == SDRPLAY_RSPduo_ID)
 	{
@@ -2103,14 +3643,25 @@ void usage(void)
 		"\t-R Refclk output enable* (default: disabled)\n"
 		"\t-f frequency to tune to [Hz]\n"
 		"\t-s samplerate in Hz (default: 2048000 Hz)\n"
-		"\t-n max number of linked list buffers to keep (default: 500)\n"
+		"\t-r native device samplerate in Hz to resample lower rates from (default: none)\n"
+		"\t-n max number of sample buffers to queue (default: 500, 0: 16384)\n"
+		"\t-l max queued samples in milliseconds (default: no limit)\n"
+		"\t-m max queued samples in bytes (default: no limit)\n"
+		"\t-c frame size in bytes (default: 131072)\n"
+		"\t-u max frame age in microseconds (default: 5000, 0: flush immediately)\n"
+		"\t-t channelizer threads (default: 0, one per processor)\n"
+		"\t-Z zero-copy send enable (Linux only, default: disabled)\n"
+		"\t-U io_uring send enable (Linux only, default: disabled)\n"
+		"\t-O queue overflow policy (oldest/newest/block[:ms], default: oldest)\n"
 		"\t-v Verbose output (debug) enable (default: disabled)\n"
 		"\t-E RSP extended mode enable (default: rtl_tcp compatible mode)\n"
 		"\t-A AM notch enable (default: disabled)\n"
 		"\t-B Broadcast notch enable (default: disabled)\n"
 		"\t-D DAB notch enable (default: disabled)\n"
 		"\t-F RF notch enable (default: disabled)\n"
-		"\t-b Sample bit-depth (8/16 default: 8)\n"
+		"\t-b Sample bit-depth (8/16, 10/12/14 packed, 32 for float, default: 8)\n"
+		"\t-q 8-bit TPDF dither enable (default: disabled)\n"
+		"\t-S 8-bit automatic scaling enable (default: disabled)\n"
 		"\t-h This help\n");
 	exit(1);
 }
@@ -2122,15 +3673,18 @@ int main(int argc, char **argv)
 	int port = 1234;
 	uint32_t frequency = DEFAULT_FREQUENCY, samp_rate = DEFAULT_SAMPLERATE;
 	struct sockaddr_in local, remote;
-	struct llist *curelem, *prev;
+	struct sample_block *curelem;
 	pthread_attr_t attr;
 	void *status;
+#ifndef HAVE_EPOLL
 	struct timeval tv = { 1,0 };
+	fd_set readfds;
+#endif
 	struct linger ling = { 1,0 };
 	SOCKET listensocket;
 	socklen_t rlen;
-	fd_set readfds;
 	dongle_info_t dongle_info;
+	size_t block_size;
 
 	float ver;
 
@@ -2149,7 +3703,7 @@ int main(int argc, char **argv)
 	struct sigaction sigact, sigign;
 #endif
 
-	while ((opt = getopt(argc, argv, "a:p:f:b:s:n:d:P:TvADBFREh")) != -1) {
+	while ((opt = getopt(argc, argv, "a:p:f:b:s:r:n:l:m:c:u:t:O:d:P:TvqSADBFREZUh")) != -1) {
 		switch (opt) {
 		case 'd':
 			device = atoi(optarg) - 1;
@@ -2166,6 +3720,13 @@ int main(int argc, char **argv)
 		case 's':
 			samp_rate = (uint32_t)atofs(optarg);
 			break;
+		case 'r':
+			native_samp_rate = (uint32_t)atofs(optarg);
+			if (native_samp_rate < 2000000 || native_samp_rate > MAX_SAMPLERATE) {
+				fprintf(stderr, "native sample rate must be between 2000000 and %d Hz\n", MAX_SAMPLERATE);
+				exit(1);
+			}
+			break;
 		case 'a':
 			addr = optarg;
 			break;
@@ -2175,6 +3736,50 @@ int main(int argc, char **argv)
 		case 'n':
 			llbuf_num = atoi(optarg);
 			break;
+		case 'l':
+			queue_max_ms = atoi(optarg);
+			break;
+		case 'm':
+			queue_max_bytes = (size_t)atofs(optarg);
+			break;
+		case 'c':
+			frame_bytes = (size_t)atofs(optarg);
+			break;
+		case 'u':
+			frame_max_age = atoi(optarg);
+			break;
+		case 't':
+			channel_threads = atoi(optarg);
+			break;
+		case 'q':
+			dither = 1;
+			break;
+		case 'S':
+			default_auto_scale = 1;
+			break;
+		case 'Z':
+			zerocopy = 1;
+			break;
+		case 'U':
+			use_uring = 1;
+			break;
+		case 'O':
+			if (strcmp(optarg, "oldest") == 0) {
+				overflow_policy = SAMPLE_QUEUE_DROP_OLDEST;
+			}
+			else if (strcmp(optarg, "newest") == 0) {
+				overflow_policy = SAMPLE_QUEUE_DROP_NEWEST;
+			}
+			else if (strncmp(optarg, "block", 5) == 0) {
+				overflow_policy = SAMPLE_QUEUE_BLOCK;
+				if (optarg[5] == ':') {
+					overflow_block_ms = atoi(optarg + 6);
+				}
+			}
+			else {
+				usage();
+			}
+			break;
 
 		case 'T':
 			enable_biastee = 1;
@@ -2211,16 +3816,58 @@ int main(int argc, char **argv)
 
 	printf(SERVER_NAME" version %s\n\n", SERVER_VERSION);
 
-	if (bit_depth != 8 && bit_depth != 16) {
+	switch (bit_depth) {
+	case 8:
+		default_sample_format = RSP_TCP_SAMPLE_FORMAT_UINT8;
+		break;
+	case 10:
+		default_sample_format = RSP_TCP_SAMPLE_FORMAT_PACKED10;
+		break;
+	case 12:
+		default_sample_format = RSP_TCP_SAMPLE_FORMAT_PACKED12;
+		break;
+	case 14:
+		default_sample_format = RSP_TCP_SAMPLE_FORMAT_PACKED14;
+		break;
+	case 16:
+		default_sample_format = RSP_TCP_SAMPLE_FORMAT_INT16;
+		break;
+	case 32:
+		default_sample_format = RSP_TCP_SAMPLE_FORMAT_FLOAT32;
+		break;
+	default:
 		usage();
+		break;
 	}
+	sample_format = default_sample_format;
+	requested_sample_format = sample_format;
 
-	sample_format = bit_depth == 16 ? RSP_TCP_SAMPLE_FORMAT_INT16 : RSP_TCP_SAMPLE_FORMAT_UINT8;
+	// the buffer count only defaults to a limit when no time or size limit is given
+	if (llbuf_num < 0) {
+		llbuf_num = (queue_max_ms || queue_max_bytes) ? 0 : DEFAULT_LLBUF_NUM;
+	}
+	else if (llbuf_num == 0 && !queue_max_ms && !queue_max_bytes) {
+		llbuf_num = SAMPLE_QUEUE_MAX_BLOCKS;
+	}
+
+#ifdef HAVE_LIBURING
+	if (use_uring && zerocopy) {
+		printf("zero-copy send is not used together with io_uring\n");
+		zerocopy = 0;
+	}
+#endif
 
 	if (argc < optind) {
 		usage();
 	}
 
+	convert_init();
+	fft_setup();
+	dsp_init();
+	chan_init(channel_threads);
+	printf("using %s sample conversion\n", convert_name());
+	update_converter();
+
 	r = sdrplay_api_Open();
 	if (r != sdrplay_api_Success) {
 		fprintf(stderr, "Cannot connect to API service\n");
@@ -2326,8 +3973,29 @@ int main(int argc, char **argv)
 	SetConsoleCtrlHandler((PHANDLER_ROUTINE)sighandler, TRUE);
 #endif
 
-	pthread_mutex_init(&ll_mutex, NULL);
-	pthread_cond_init(&cond, NULL);
+	// the output blocks are the frames that get sent in one go
+	if (frame_bytes < MIN_FRAME_BYTES) {
+		frame_bytes = MIN_FRAME_BYTES;
+	}
+	block_size = frame_bytes;
+	// frames are bounded by the byte limits, the block count only by the ring
+	if (sample_queue_init(&sample_queue, 0) != 0 ||
+		sample_pool_init(&sample_pool, pool_block_count(block_size), block_size) != 0 ||
+		sample_queue_init(&raw_queue, raw_pool_count()) != 0 ||
+		sample_pool_init(&raw_pool, raw_pool_count(), RAW_BLOCK_SAMPLES * 2 * sizeof(short)) != 0) {
+		fprintf(stderr, "failed to allocate the sample queue\n");
+		sdrplay_api_ReleaseDevice(chosenDev);
+		sdrplay_api_Close();
+		exit(1);
+	}
+
+	if (use_uring) {
+#ifdef HAVE_LIBURING
+		uring_active = tcp_uring_init(TCP_MAX_IOV, sample_pool.slab, (size_t)sample_pool.count * sample_pool.block_size) == 0;
+#else
+		printf("io_uring support not compiled in, using send()\n");
+#endif
+	}
 
 	memset(&local, 0, sizeof(local));
 	local.sin_family = AF_INET;
@@ -2348,6 +4016,17 @@ int main(int argc, char **argv)
 	r = fcntl(listensocket, F_SETFL, r | O_NONBLOCK);
 #endif
 
+#ifdef HAVE_EPOLL
+	exit_event = eventfd(do_exit ? 1 : 0, EFD_NONBLOCK | EFD_CLOEXEC);
+	sample_event = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (exit_event < 0 || sample_event < 0 ||
+		(listen_epoll = create_epoll(listensocket, EPOLLIN, -1)) < 0) {
+		fprintf(stderr, "failed to set up epoll\n");
+		goto out;
+	}
+	sample_queue_set_event(&sample_queue, sample_event);
+#endif
+
 	while (1) {
 		printf("listening...\n");
 
@@ -2361,6 +4040,18 @@ int main(int argc, char **argv)
 		listen(listensocket, 1);
 
 		while (1) {
+#ifdef HAVE_EPOLL
+			// the listen socket is non-blocking and edge triggered, try first
+			if (do_exit) {
+				goto out;
+			}
+			rlen = sizeof(remote);
+			s = accept(listensocket, (struct sockaddr *)&remote, &rlen);
+			if (s != SOCKET_ERROR) {
+				break;
+			}
+			wait_epoll(listen_epoll, 1000);
+#else
 			FD_ZERO(&readfds);
 			FD_SET(listensocket, &readfds);
 			tv.tv_sec = 1;
@@ -2374,12 +4065,38 @@ int main(int argc, char **argv)
 				s = accept(listensocket, (struct sockaddr *)&remote, &rlen);
 				break;
 			}
+#endif
 		}
 
 		setsockopt(s, SOL_SOCKET, SO_LINGER, (char *)&ling, sizeof(ling));
+		zerocopy_enable(s);
 
 		printf("client accepted!\n");
 
+		// every connection starts with the format from the command line
+		sample_format = default_sample_format;
+		requested_sample_format = sample_format;
+		sample_shift = DEFAULT_SAMPLE_SHIFT;
+		auto_scale = requested_auto_scale = default_auto_scale;
+		auto_scale_quiet = 0;
+		auto_scale_clipped = 0;
+		auto_scale_power = -1;
+		shift_markers = 0;
+		update_converter();
+
+		// and with the samples of the full band
+		requested_spectrum_window = RSP_TCP_SPECTRUM_WINDOW_HANN;
+		requested_spectrum_average = 0;
+		requested_spectrum_rate = DEFAULT_SPECTRUM_RATE;
+		if (requested_ddc_rate || requested_channels || requested_spectrum_size) {
+			requested_channels = 0;
+			requested_spectrum_size = 0;
+			set_ddc(0, 0);
+		}
+		requested_ddc_offset = 0;
+		rate_markers = 0;
+		channel_markers = 0;
+
 		memset(&dongle_info, 0, sizeof(dongle_info));
 		memcpy(&dongle_info.magic, "RTL0", 4);
 
@@ -2404,6 +4121,7 @@ int main(int argc, char **argv)
 			rsp_cap.hardware_version = htonl(hardware_version);
 			rsp_cap.capabilities = htonl(hardware_caps->capabilities);
 			rsp_cap.sample_format = htonl(sample_format);
+			rsp_cap.sample_formats = htonl(SUPPORTED_SAMPLE_FORMATS);
 
 			rsp_cap.antenna_input_count = hardware_caps->antenna_input_count;
 			strcpy(rsp_cap.third_antenna_name, hardware_caps->third_antenna_name);
@@ -2418,6 +4136,19 @@ int main(int argc, char **argv)
 			}
 		}
 
+#ifdef HAVE_EPOLL
+		// from here on the socket threads only sleep in epoll
+		r = fcntl(s, F_GETFL, 0);
+		fcntl(s, F_SETFL, r | O_NONBLOCK);
+		worker_epoll = create_epoll(s, EPOLLOUT, sample_event);
+		send_epoll = create_epoll(s, EPOLLOUT, -1);
+		command_epoll = create_epoll(s, EPOLLIN | EPOLLRDHUP, -1);
+		if (worker_epoll < 0 || send_epoll < 0 || command_epoll < 0) {
+			printf("failed to set up epoll\n");
+			break;
+		}
+#endif
+
 		// must start the tcp_worker before the first samples are available from the rx
 		// because the rx_callback tries to send a condition to the worker thread
 		pthread_attr_init(&attr);
@@ -2428,6 +4159,12 @@ int main(int argc, char **argv)
 			break;
 		}
 
+		r = pthread_create(&convert_thread, &attr, convert_worker, NULL);
+		if (r != 0) {
+			printf("failed to create conversion thread\n");
+			break;
+		}
+
 		// initialise API and start the rx		
 		r = init_rsp_device(samp_rate, frequency, enable_biastee, notch, enable_refout, antenna);
 		if (r != 0) {
@@ -2446,24 +4183,47 @@ int main(int argc, char **argv)
 		// wait for the workers to exit
 		pthread_join(tcp_worker_thread, &status);
 		pthread_join(command_thread, &status);
+		pthread_join(convert_thread, &status);
 
 		closesocket(s);
+		zerocopy_drop_pending();
+#ifdef HAVE_EPOLL
+		close(worker_epoll);
+		close(send_epoll);
+		close(command_epoll);
+		worker_epoll = -1;
+		send_epoll = -1;
+		command_epoll = -1;
+#endif
 
 		// stop the receiver
 		sdrplay_api_Uninit(chosenDev->dev);
 		printf("all threads dead..\n");
 
-		curelem = ll_buffers;
-		ll_buffers = 0;
-
-		while (curelem != 0) {
-			prev = curelem;
-			curelem = curelem->next;
-			free(prev->data);
-			free(prev);
+		while ((curelem = sample_queue_pop(&raw_queue)) != NULL) {
+			sample_pool_put(&raw_pool, curelem);
+		}
+		while ((curelem = sample_queue_pop(&sample_queue)) != NULL) {
+			keep_spare_block(curelem);
+		}
+		while ((curelem = spare_blocks) != NULL) {
+			spare_blocks = curelem->next;
+			sample_pool_put(&sample_pool, curelem);
+		}
+		report_queue_stats();
+		report_rice_stats(1);
+		if (sample_drops.total_blocks || raw_drops.total_blocks) {
+			printf("dropped %llu samples in total\n", sample_drops.total_samples + raw_drops.total_samples);
 		}
+		sample_pool.dry = 0;
+		reported_pool_dry = 0;
+		sample_drops.total_blocks = sample_drops.total_samples = 0;
+		raw_drops.total_blocks = raw_drops.total_samples = 0;
 
 		if (!ctrlC_exit) do_exit = 0;
+#ifdef HAVE_EPOLL
+		if (!do_exit) clear_exit_event();
+#endif
 		global_numq = 0;
 	}
 
@@ -2471,8 +4231,21 @@ out:
 	sdrplay_api_ReleaseDevice(chosenDev);
 	sdrplay_api_Close();
 
+#ifdef HAVE_LIBURING
+	tcp_uring_exit();
+#endif
+	sample_pool_destroy(&raw_pool);
+	sample_queue_destroy(&raw_queue);
+	sample_pool_destroy(&sample_pool);
+	sample_queue_destroy(&sample_queue);
+
 	closesocket(listensocket);
 	closesocket(s);
+#ifdef HAVE_EPOLL
+	if (listen_epoll >= 0) close(listen_epoll);
+	if (exit_event >= 0) close(exit_event);
+	if (sample_event >= 0) close(sample_event);
+#endif
 #ifdef _WIN32
 	WSACleanup();
 #endif
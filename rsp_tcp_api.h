@@ -12,7 +12,7 @@
 #define RSP_CAPABILITY_AGC (1 << 7)
 
 #define RSP_CAPABILITIES_MAGIC "RSP0"
-#define RSP_CAPABILITIES_VERSION (0x00000001)
+#define RSP_CAPABILITIES_VERSION (0x00000002)
 
 /* ******************************************************************************* */
 
@@ -26,7 +26,25 @@ typedef enum
 	RSP_TCP_COMMAND_SET_AGC_SETPOINT = RSP_TCP_COMMAND_BASE + 4,
 	RSP_TCP_COMMAND_SET_NOTCH = RSP_TCP_COMMAND_BASE + 5,
 	RSP_TCP_COMMAND_SET_BIAST = RSP_TCP_COMMAND_BASE + 6,
-	RSP_TCP_COMMAND_SET_REFOUT = RSP_TCP_COMMAND_BASE + 7,		
+	RSP_TCP_COMMAND_SET_REFOUT = RSP_TCP_COMMAND_BASE + 7,
+	RSP_TCP_COMMAND_SET_SAMPLE_FORMAT = RSP_TCP_COMMAND_BASE + 8,
+	RSP_TCP_COMMAND_SET_AUTO_SCALE = RSP_TCP_COMMAND_BASE + 9,
+	// signed offset in Hz from the tuned frequency, of the down-converter
+	RSP_TCP_COMMAND_SET_DDC_OFFSET = RSP_TCP_COMMAND_BASE + 10,
+	// output rate in Hz of the down-converter, 0 streams the full band again
+	RSP_TCP_COMMAND_SET_DDC_RATE = RSP_TCP_COMMAND_BASE + 11,
+	// channel count of the channelizer, 0 for off, see RSP_TCP_CHANNELIZER_OVERSAMPLE
+	RSP_TCP_COMMAND_SET_CHANNELIZER = RSP_TCP_COMMAND_BASE + 12,
+	// channel number, see RSP_TCP_CHANNEL_SELECTED
+	RSP_TCP_COMMAND_SELECT_CHANNEL = RSP_TCP_COMMAND_BASE + 13,
+	// FFT size of the spectrum frames, 0 for samples again, see rsp_tcp_spectrum_header_t
+	RSP_TCP_COMMAND_SET_SPECTRUM = RSP_TCP_COMMAND_BASE + 14,
+	// see enum rsp_tcp_spectrum_window_t
+	RSP_TCP_COMMAND_SET_SPECTRUM_WINDOW = RSP_TCP_COMMAND_BASE + 15,
+	// transforms averaged in each spectrum frame, 0 for all the input allows
+	RSP_TCP_COMMAND_SET_SPECTRUM_AVERAGE = RSP_TCP_COMMAND_BASE + 16,
+	// spectrum frames per second
+	RSP_TCP_COMMAND_SET_SPECTRUM_RATE = RSP_TCP_COMMAND_BASE + 17,
 } rsp_tcp_commands_t;
 
 typedef enum
@@ -59,9 +77,84 @@ typedef enum
 typedef enum
 {
 	RSP_TCP_SAMPLE_FORMAT_UINT8 = 0x1,
-	RSP_TCP_SAMPLE_FORMAT_INT16 = 0x2
+	RSP_TCP_SAMPLE_FORMAT_INT16 = 0x2,
+	// interleaved IEEE 754 single precision I/Q, little endian, full scale = 1.0
+	RSP_TCP_SAMPLE_FORMAT_FLOAT32 = 0x3,
+	// top 10/12/14 bits of the 14-bit ADC range, bit packed, see rsp_tcp_unpack()
+	RSP_TCP_SAMPLE_FORMAT_PACKED10 = 0x4,
+	RSP_TCP_SAMPLE_FORMAT_PACKED12 = 0x5,
+	RSP_TCP_SAMPLE_FORMAT_PACKED14 = 0x6,
+	// block floating point, 8 or 6-bit mantissas, see rsp_tcp_unpack_bfp()
+	RSP_TCP_SAMPLE_FORMAT_BFP8 = 0x7,
+	RSP_TCP_SAMPLE_FORMAT_BFP6 = 0x8,
+	// lossless INT16, Rice coded prediction residuals, see rsp_tcp_rice_header_t
+	RSP_TCP_SAMPLE_FORMAT_RICE16 = 0x9
 } rsp_tcp_sample_format_t;
 
+#define RSP_TCP_SAMPLE_FORMAT_BIT(f) (1 << (f))
+
+// I/Q samples per packed group, a group takes bits / 2 bytes
+#define RSP_TCP_PACKED_GROUP_SAMPLES 2
+
+// I/Q samples per block floating point block, a block takes 1 + 64 * bits / 8 bytes
+#define RSP_TCP_BFP_BLOCK_SAMPLES 32
+
+// most I/Q samples in a Rice block
+#define RSP_TCP_RICE_BLOCK_SAMPLES 256
+
+// a unary run of this many ones is followed by the raw 16-bit sample
+#define RSP_TCP_RICE_ESCAPE 16
+
+// largest Rice parameter and predictor order in a block header, residuals
+// of 16-bit samples never need a larger parameter
+#define RSP_TCP_RICE_MAX_K 15
+#define RSP_TCP_RICE_MAX_ORDER 2
+
+typedef enum
+{
+	RSP_TCP_MARKER_SAMPLE_FORMAT = 0x1,
+	// 8-bit samples are round(x * 2^value / 256) of the int16 sample x
+	RSP_TCP_MARKER_SAMPLE_SHIFT = 0x2,
+	// sample rate in Hz, of each channel for the channelizer, rounded down
+	RSP_TCP_MARKER_SAMPLE_RATE = 0x3,
+	// number of channels interleaved sample by sample
+	RSP_TCP_MARKER_CHANNELS = 0x4,
+	// FFT size of the spectrum frames that follow, 0 when samples follow
+	RSP_TCP_MARKER_SPECTRUM = 0x5
+} rsp_tcp_marker_type_t;
+
+/*
+ * Channelizer. RSP_TCP_COMMAND_SET_CHANNELIZER splits the stream into a
+ * power of two number of channels from 2 to 1024, equally spaced over the
+ * sample rate. Channel c of n is centred (c - n / 2) * rate / n off the
+ * tuned frequency and comes at rate / n, or at twice that with
+ * RSP_TCP_CHANNELIZER_OVERSAMPLE, which leaves room for the whole channel
+ * without aliases at its edges. Every channel starts out selected;
+ * RSP_TCP_COMMAND_SELECT_CHANNEL with or without RSP_TCP_CHANNEL_SELECTED
+ * adds one to the stream or takes it out. The stream then carries one
+ * sample of each selected channel in turn, lowest channel number first,
+ * announced by RSP_TCP_MARKER_CHANNELS.
+ */
+#define RSP_TCP_CHANNELIZER_OVERSAMPLE 0x80000000
+#define RSP_TCP_CHANNEL_SELECTED 0x80000000
+
+typedef enum
+{
+	RSP_TCP_SPECTRUM_WINDOW_RECTANGULAR = 0x0,
+	RSP_TCP_SPECTRUM_WINDOW_HANN = 0x1,
+	// 4-term, about 92 dB of sidelobe suppression
+	RSP_TCP_SPECTRUM_WINDOW_BLACKMAN_HARRIS = 0x2
+} rsp_tcp_spectrum_window_t;
+
+// FFT sizes of the spectrum, powers of two
+#define RSP_TCP_SPECTRUM_MIN_SIZE 64
+#define RSP_TCP_SPECTRUM_MAX_SIZE 65536
+
+#define RSP_TCP_SPECTRUM_MAX_RATE 100
+
+// the bin value v stands for (v - 255) / RSP_TCP_SPECTRUM_STEPS_PER_DB dB relative to full scale
+#define RSP_TCP_SPECTRUM_STEPS_PER_DB 1.6
+
 
 /* ******************************************************************************* */
 
@@ -79,8 +172,9 @@ typedef struct {
 	// Capabilities bitmap
 	unsigned int capabilities;
 
-	// Reserved for future use
-	unsigned int __reserved__;
+	// Formats accepted by RSP_TCP_COMMAND_SET_SAMPLE_FORMAT, one
+	// RSP_TCP_SAMPLE_FORMAT_BIT() per format (version 2 and later)
+	unsigned int sample_formats;
 
 	// Hardware version from library
 	unsigned int hardware_version;
@@ -96,8 +190,218 @@ typedef struct {
 	unsigned char ifgr_min;
 	unsigned char ifgr_max;
 } __attribute__((packed)) rsp_extended_capabilities_t;
+
+#define RSP_TCP_MARKER_MAGIC "RSPM"
+
+/*
+ * In-stream marker, sent between two sample frames when a stream property
+ * changes in response to a client command, e.g. the sample format after
+ * RSP_TCP_COMMAND_SET_SAMPLE_FORMAT, or, once a client has sent
+ * RSP_TCP_COMMAND_SET_AUTO_SCALE, the current and every later 8-bit sample
+ * shift. A client that has used the down-converter or channelizer commands
+ * gets the current and every later sample rate and channel count the same
+ * way. Everything after the marker uses the new value. A marker always
+ * starts on a sample boundary of the format in use before it (a group or
+ * block boundary for the packed and block floating point formats, a frame
+ * boundary for spectrum frames), so after sending such a command a client
+ * checks each sample boundary for the magic and the check word. All fields
+ * are in network byte order.
+ */
+typedef struct {
+	// "RSPM"
+	char magic[4];
+
+	// see enum rsp_tcp_marker_type_t
+	unsigned int type;
+
+	// new value, e.g. a rsp_tcp_sample_format_t
+	unsigned int value;
+
+	// ~(type ^ value), tells a real marker from samples that look like one
+	unsigned int check;
+} __attribute__((packed)) rsp_tcp_marker_t;
+
+/*
+ * Header of a RSP_TCP_SAMPLE_FORMAT_RICE16 block. Blocks are independent,
+ * each is this header followed by a bit stream of the I residuals, then the
+ * Q residuals, padded to a whole byte. Bits are taken LSB first from
+ * little-endian bytes.
+ *
+ * Per component the predictor gives the residual e = x[n] - p[n], with p = 0
+ * (order 0), x[n-1] (order 1) or 2x[n-1] - x[n-2] (order 2) and x = 0 before
+ * the block. e is mapped to u = (e << 1) ^ (e >> 31) and coded as u >> k one
+ * bits, a zero bit and the low k bits of u. When u >> k would reach
+ * RSP_TCP_RICE_ESCAPE the code is RSP_TCP_RICE_ESCAPE one bits followed by
+ * the 16-bit sample itself. See rsp_tcp_unpack_rice(). The sizes are in
+ * network byte order.
+ */
+typedef struct {
+	// size of the block, header included
+	unsigned short bytes;
+
+	// I/Q samples in the block, at most RSP_TCP_RICE_BLOCK_SAMPLES
+	unsigned short samples;
+
+	// predictor order for I and Q
+	unsigned char order[2];
+
+	// Rice parameter for I and Q
+	unsigned char k[2];
+} __attribute__((packed)) rsp_tcp_rice_header_t;
+
+#define RSP_TCP_SPECTRUM_MAGIC "RSPS"
+
+/*
+ * Spectrum frame. After RSP_TCP_COMMAND_SET_SPECTRUM the client gets
+ * spectrum frames instead of samples, behind a RSP_TCP_MARKER_SPECTRUM
+ * marker. Each is this header followed by one byte per bin, the bins of the
+ * input rate from the lowest frequency up, bin size / 2 at the tuned
+ * frequency (or at the down-converter offset when it is on). A bin holds
+ * the mean power of the transforms in the frame, windowed and scaled so
+ * that a tone at int16 full scale reads 0 dB, as
+ * 255 + RSP_TCP_SPECTRUM_STEPS_PER_DB * dB rounded and clipped to 0..255,
+ * i.e. 0.625 dB steps down to -159.4 dB. The fields are in network byte
+ * order.
+ */
+typedef struct {
+	// "RSPS"
+	char magic[4];
+
+	// FFT size, the number of bin bytes that follow
+	unsigned int size;
+
+	// sample rate in Hz the bins divide up
+	unsigned int rate;
+
+	// transforms averaged in this frame
+	unsigned int transforms;
+} __attribute__((packed)) rsp_tcp_spectrum_header_t;
 #ifdef _WIN32
 #pragma pack(pop)
 #endif
 
+/*
+ * Reference unpacker for the packed formats. Each group of 2 I/Q samples is
+ * I0 Q0 I1 Q1 as bits-wide two's complement fields, LSB first, in bits / 2
+ * little-endian bytes. Unpacks n samples (a multiple of
+ * RSP_TCP_PACKED_GROUP_SAMPLES) into interleaved I/Q at the packed scale,
+ * i.e. [-2^(bits-1), 2^(bits-1)-1].
+ */
+static __inline void rsp_tcp_unpack(const unsigned char *in, short *out, unsigned int n, unsigned int bits)
+{
+	unsigned long long group;
+	unsigned int i, k;
+	int v;
+
+	for (i = 0; i < n; i += RSP_TCP_PACKED_GROUP_SAMPLES) {
+		group = 0;
+		for (k = 0; k < bits / 2; k++) {
+			group |= (unsigned long long)*(in++) << (8 * k);
+		}
+
+		for (k = 0; k < 4; k++) {
+			v = (int)((group >> (k * bits)) & ((1u << bits) - 1));
+			*(out++) = (short)(v >= (1 << (bits - 1)) ? v - (1 << bits) : v);
+		}
+	}
+}
+
+/*
+ * Reference decoder for the block floating point formats. A block of
+ * RSP_TCP_BFP_BLOCK_SAMPLES starts with an exponent byte, followed by the
+ * interleaved I/Q mantissas as bits-wide two's complement values: one byte
+ * each for 8 bits, four to three bytes LSB first for 6 bits. Decodes n
+ * samples (a multiple of the block size) into interleaved I/Q at the scale
+ * of RSP_TCP_SAMPLE_FORMAT_INT16, mantissa << exponent.
+ */
+static __inline void rsp_tcp_unpack_bfp(const unsigned char *in, short *out, unsigned int n, unsigned int bits)
+{
+	unsigned int group = 0;
+	unsigned int i, k, e;
+	int v;
+
+	for (i = 0; i < n; i += RSP_TCP_BFP_BLOCK_SAMPLES) {
+		e = *(in++);
+		for (k = 0; k < 2 * RSP_TCP_BFP_BLOCK_SAMPLES; k++) {
+			if (bits == 8) {
+				v = (signed char)*(in++);
+			}
+			else {
+				if (k % 4 == 0) {
+					group = in[0] | in[1] << 8 | in[2] << 16;
+					in += 3;
+				}
+				v = (int)((group >> (6 * (k % 4))) & 0x3f);
+				v = v >= 32 ? v - 64 : v;
+			}
+			*(out++) = (short)(v * (1 << e));
+		}
+	}
+}
+
+/*
+ * Reference decoder for one RSP_TCP_SAMPLE_FORMAT_RICE16 block, in must hold
+ * the whole block (see the bytes field of the header). Writes the samples of
+ * the block as interleaved I/Q and returns their number, 0 for a damaged
+ * block. Nothing past the bytes of the header is read.
+ */
+static __inline unsigned int rsp_tcp_unpack_rice(const unsigned char *in, short *out)
+{
+	const rsp_tcp_rice_header_t *h = (const rsp_tcp_rice_header_t *)in;
+	unsigned int bytes = (unsigned int)in[0] << 8 | in[1];
+	unsigned int samples = (unsigned int)in[2] << 8 | in[3];
+	unsigned int pos = 8 * sizeof(rsp_tcp_rice_header_t);
+	unsigned int end = 8 * bytes;
+	unsigned int c, i, q, b, u;
+	int x, x1, x2, e;
+
+	if (samples > RSP_TCP_RICE_BLOCK_SAMPLES || bytes < sizeof(rsp_tcp_rice_header_t) ||
+		h->k[0] > RSP_TCP_RICE_MAX_K || h->k[1] > RSP_TCP_RICE_MAX_K ||
+		h->order[0] > RSP_TCP_RICE_MAX_ORDER || h->order[1] > RSP_TCP_RICE_MAX_ORDER) {
+		return 0;
+	}
+
+#define RSP_TCP_RICE_BIT(p) ((in[(p) >> 3] >> ((p) & 7)) & 1)
+	for (c = 0; c < 2; c++) {
+		x1 = x2 = 0;
+		for (i = 0; i < samples; i++) {
+			// every read is checked against the end of the block before it is made
+			for (q = 0; q < RSP_TCP_RICE_ESCAPE; q++, pos++) {
+				if (pos + 1 > end) {
+					return 0;
+				}
+				if (!RSP_TCP_RICE_BIT(pos)) {
+					break;
+				}
+			}
+			if (q == RSP_TCP_RICE_ESCAPE) {
+				if (pos + 16 > end) {
+					return 0;
+				}
+				for (x = 0, b = 0; b < 16; b++, pos++) {
+					x |= RSP_TCP_RICE_BIT(pos) << b;
+				}
+				x = (short)x;
+			}
+			else {
+				// the zero bit ending the unary run was checked above
+				if (++pos + h->k[c] > end) {
+					return 0;
+				}
+				for (u = q << h->k[c], b = 0; b < h->k[c]; b++, pos++) {
+					u |= RSP_TCP_RICE_BIT(pos) << b;
+				}
+				e = (int)(u >> 1) ^ -(int)(u & 1);
+				x = e + (h->order[c] == 2 ? 2 * x1 - x2 : h->order[c] == 1 ? x1 : 0);
+			}
+			out[2 * i + c] = (short)x;
+			x2 = x1;
+			x1 = x;
+		}
+	}
+#undef RSP_TCP_RICE_BIT
+
+	return samples;
+}
+
 #endif /* RSP_TCP_API_H */
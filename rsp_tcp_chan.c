@@ -0,0 +1,224 @@
+/*
+* rsp_tcp - filter bank channelizer
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stddef.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+#define HAVE_STRUCT_TIMESPEC
+#include <pthread.h>
+
+#include "rsp_tcp_chan.h"
+
+// taps worth waking another thread for, about as long as the wakeup takes several times over
+#define CHAN_MIN_WORK (1 << 17)
+
+static dsp_channelizer_t channelizer;
+
+// prototype history followed by the new input
+static float x[2][DSP_MAX_CHANNELS * DSP_CHANNEL_TAPS + CHAN_CHUNK];
+static unsigned int nx;
+
+// one more than the index of the newest input sample of the next row, modulo the channel count
+static unsigned int phase;
+
+static unsigned int bins[DSP_MAX_CHANNELS];
+static unsigned int nbins;
+
+// rows of the running call, parts is only changed under the lock
+static struct {
+	unsigned int rows;
+	unsigned int parts;
+	short *yi, *yq;
+} job;
+
+static unsigned int threads = 1;
+static unsigned int generation;
+static unsigned int pending;
+static pthread_mutex_t lock;
+static pthread_cond_t start_cond;
+static pthread_cond_t done_cond;
+
+static void run_part(unsigned int i, unsigned int parts)
+{
+	unsigned int first = job.rows * i / parts;
+	unsigned int last = job.rows * (i + 1) / parts;
+
+	dsp_channelize(&channelizer, x[0] + first * channelizer.step, x[1] + first * channelizer.step, last - first,
+		(phase + first * channelizer.step) & (channelizer.channels - 1), bins, nbins,
+		job.yi + first * nbins, job.yq + first * nbins);
+}
+
+static void *chan_worker(void *arg)
+{
+	unsigned int i = (unsigned int)(size_t)arg;
+	unsigned int seen = 0, parts;
+
+	pthread_mutex_lock(&lock);
+	while (1) {
+		while (generation == seen) {
+			pthread_cond_wait(&start_cond, &lock);
+		}
+		seen = generation;
+		parts = job.parts;
+		if (i < parts) {
+			pthread_mutex_unlock(&lock);
+			run_part(i, parts);
+			pthread_mutex_lock(&lock);
+			if (--pending == 0) {
+				pthread_cond_signal(&done_cond);
+			}
+		}
+	}
+
+	return NULL;
+}
+
+int chan_init(unsigned int count)
+{
+	pthread_attr_t attr;
+	pthread_t thread;
+	unsigned int i;
+#ifdef _WIN32
+	SYSTEM_INFO info;
+
+	GetSystemInfo(&info);
+	if (count == 0) {
+		count = info.dwNumberOfProcessors;
+	}
+#else
+	long online = sysconf(_SC_NPROCESSORS_ONLN);
+
+	if (count == 0) {
+		count = online > 0 ? (unsigned int)online : 1;
+	}
+#endif
+	if (count > CHAN_MAX_THREADS) {
+		count = CHAN_MAX_THREADS;
+	}
+
+	pthread_mutex_init(&lock, NULL);
+	pthread_cond_init(&start_cond, NULL);
+	pthread_cond_init(&done_cond, NULL);
+
+	// the helpers sleep until the first call that has work for them
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	for (i = 1; i < count; i++) {
+		if (pthread_create(&thread, &attr, chan_worker, (void *)(size_t)i)) {
+			break;
+		}
+	}
+	pthread_attr_destroy(&attr);
+	threads = i;
+
+	return 0;
+}
+
+int chan_configure(unsigned int channels, unsigned int step)
+{
+	unsigned int mask[CHAN_MASK_WORDS];
+
+	if (dsp_channelizer_init(&channelizer, channels, step)) {
+		return -1;
+	}
+
+	// the first row ends on the first input sample
+	nx = channels * DSP_CHANNEL_TAPS - 1;
+	memset(x[0], 0, nx * sizeof(float));
+	memset(x[1], 0, nx * sizeof(float));
+	phase = 1;
+
+	memset(mask, 0xff, sizeof(mask));
+	chan_select(mask);
+
+	return 0;
+}
+
+void chan_select(const unsigned int *mask)
+{
+	unsigned int c;
+
+	// bin 0 is at 0 Hz, the bins of the upper half are the negative frequencies
+	nbins = 0;
+	for (c = 0; c < channelizer.channels; c++) {
+		if (mask[c / 32] & (1u << (c % 32))) {
+			bins[nbins++] = c ^ (channelizer.channels / 2);
+		}
+	}
+}
+
+unsigned int chan_selected(void)
+{
+	return nbins;
+}
+
+unsigned int chan_run(const short *xi, const short *xq, unsigned int n, short *yi, short *yq)
+{
+	unsigned int i, c, rows, parts, used, taps = channelizer.channels * DSP_CHANNEL_TAPS;
+
+	for (i = 0; i < n; i++) {
+		x[0][nx + i] = xi[i];
+		x[1][nx + i] = xq[i];
+	}
+	nx += n;
+
+	rows = nx < taps ? 0 : (nx - taps) / channelizer.step + 1;
+	job.rows = rows;
+	job.yi = yi;
+	job.yq = yq;
+
+	// the conversion thread takes the first part itself
+	parts = (unsigned int)((unsigned long long)rows * taps / CHAN_MIN_WORK);
+	if (parts > threads) {
+		parts = threads;
+	}
+	if (parts > 1) {
+		pthread_mutex_lock(&lock);
+		job.parts = parts;
+		pending = parts - 1;
+		generation++;
+		pthread_cond_broadcast(&start_cond);
+		pthread_mutex_unlock(&lock);
+
+		run_part(0, parts);
+
+		pthread_mutex_lock(&lock);
+		while (pending) {
+			pthread_cond_wait(&done_cond, &lock);
+		}
+		pthread_mutex_unlock(&lock);
+	}
+	else {
+		run_part(0, 1);
+	}
+
+	// keep what the next rows still need
+	used = rows * channelizer.step;
+	for (c = 0; c < 2; c++) {
+		memmove(x[c], x[c] + used, (nx - used) * sizeof(float));
+	}
+	nx -= used;
+	phase = (phase + used) & (channelizer.channels - 1);
+
+	return rows * nbins;
+}
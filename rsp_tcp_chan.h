@@ -0,0 +1,45 @@
+#ifndef _RSP_TCP_CHAN_H
+#define _RSP_TCP_CHAN_H
+
+#include "rsp_tcp_dsp.h"
+
+/*
+ * Filter bank channelizer of the conversion thread.
+ *
+ * The input is kept in float with the history the prototype filter needs,
+ * and the outputs each chan_run() call makes possible are shared out to
+ * helper threads in runs of consecutive rows. All rows read the same
+ * history and write their own part of the output, so the threads never
+ * wait for each other until the call returns.
+ *
+ * Channels are counted from the lowest frequency: channel c of n is centred
+ * (c - n / 2) / n of the input rate off the centre, channel n / 2 at 0 Hz.
+ */
+
+// input samples per chan_run()
+#define CHAN_CHUNK 16384
+
+// most samples a chan_run() call can return
+#define CHAN_MAX_OUTPUT (2 * CHAN_CHUNK + DSP_MAX_CHANNELS)
+
+#define CHAN_MAX_THREADS 16
+
+// words of a channel selection mask, bit c % 32 of word c / 32 for channel c
+#define CHAN_MASK_WORDS (DSP_MAX_CHANNELS / 32)
+
+// starts threads - 1 helpers, 0 for one thread per processor
+int chan_init(unsigned int threads);
+
+// restarts from silence with every channel selected, returns -1 for what dsp_channelizer_init() cannot do
+int chan_configure(unsigned int channels, unsigned int step);
+
+// takes effect with the next row
+void chan_select(const unsigned int *mask);
+
+// samples in each row of the output
+unsigned int chan_selected(void);
+
+// n is at most CHAN_CHUNK, returns the number of samples written to y: whole rows in order of the channels
+unsigned int chan_run(const short *xi, const short *xq, unsigned int n, short *yi, short *yq);
+
+#endif /* _RSP_TCP_CHAN_H */
@@ -0,0 +1,1285 @@
+/*
+* rsp_tcp - sample format conversion kernels
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "rsp_tcp_convert.h"
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define CONVERT_X86
+#include <emmintrin.h>
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define CONVERT_NEON
+#include <arm_neon.h>
+#if defined(__linux__) && !defined(__aarch64__)
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+#endif
+
+#ifdef _MSC_VER
+#define CONVERT_TARGET(t)
+#define CONVERT_INLINE static __forceinline
+#else
+#define CONVERT_TARGET(t) __attribute__((target(t)))
+#define CONVERT_INLINE static inline __attribute__((always_inline))
+#endif
+
+// int16 full scale maps to 1.0, a power of two so every variant rounds the same
+#define CONVERT_FLOAT32_SCALE (1.0f / 32768.0f)
+
+/*
+ * Kernel bodies. They take the shift and the dither switch as arguments but
+ * are always inlined into the generated wrappers below, where they are
+ * constants.
+ */
+
+/*
+ * 8-bit requantizer: the sample is scaled by 2^shift / 256, rounded to
+ * nearest and saturated to the int8 range instead of wrapping, then offset
+ * by 128. With dither, TPDF noise of up to +-1 output LSB is added before
+ * the rounding. It comes from eight xorshift32 generators stepped in
+ * lockstep, one per vector lane: for every run of 8 samples all lanes step
+ * once for I and once for Q, and lane j dithers sample j of the run. Shifts
+ * of 8 and up have nothing to round and draw no dither.
+ */
+
+#define CONVERT_DITHER_LANES 8
+
+// only the conversion thread touches the generators
+static unsigned int dither_lanes[CONVERT_DITHER_LANES];
+
+CONVERT_INLINE unsigned int dither_step(unsigned int *x)
+{
+	*x ^= *x << 13;
+	*x ^= *x >> 17;
+	*x ^= *x << 5;
+	return *x;
+}
+
+// difference of two uniform m-bit numbers, one from each half of w
+CONVERT_INLINE int dither_value(unsigned int w, int m)
+{
+	return (int)((w << 16) >> (32 - m)) - (int)(w >> (32 - m));
+}
+
+CONVERT_INLINE int requantize(int x, int shift, int d)
+{
+	if (shift < 8) {
+		x = (x + d + (1 << (7 - shift))) >> (8 - shift);
+	}
+	else {
+		x *= 1 << (shift - 8);
+	}
+
+	return x > 127 ? 127 : x < -128 ? -128 : x;
+}
+
+CONVERT_INLINE void uint8_scalar(unsigned char *out, const short *xi, const short *xq, unsigned int n, int shift, int dither)
+{
+	int di[CONVERT_DITHER_LANES] = { 0 }, dq[CONVERT_DITHER_LANES] = { 0 };
+	unsigned int i, j;
+
+	dither = dither && shift < 8;
+	for (i = 0; i < n; i += CONVERT_DITHER_LANES)
+	{
+		if (dither) {
+			for (j = 0; j < CONVERT_DITHER_LANES; j++) {
+				di[j] = dither_value(dither_step(&dither_lanes[j]), 8 - shift);
+			}
+			for (j = 0; j < CONVERT_DITHER_LANES; j++) {
+				dq[j] = dither_value(dither_step(&dither_lanes[j]), 8 - shift);
+			}
+		}
+
+		for (j = 0; j < CONVERT_DITHER_LANES && i + j < n; j++) {
+			*(out++) = (unsigned char)(requantize(xi[i + j], shift, di[j]) + 128);
+			*(out++) = (unsigned char)(requantize(xq[i + j], shift, dq[j]) + 128);
+		}
+	}
+}
+
+CONVERT_INLINE void int16_scalar(short *out, const short *xi, const short *xq, unsigned int n)
+{
+	unsigned int i;
+
+	for (i = 0; i < n; i++, xi++, xq++)
+	{
+		*(out++) = *xi;
+		*(out++) = *xq;
+	}
+}
+
+CONVERT_INLINE void float32_scalar(float *out, const short *xi, const short *xq, unsigned int n)
+{
+	unsigned int i;
+
+	for (i = 0; i < n; i++, xi++, xq++)
+	{
+		*(out++) = *xi * CONVERT_FLOAT32_SCALE;
+		*(out++) = *xq * CONVERT_FLOAT32_SCALE;
+	}
+}
+
+/*
+ * Packed formats keep the top bits of the 14-bit ADC range, saturated, and
+ * put the four components of a group (I0 Q0 I1 Q1) LSB first into
+ * bits / 2 little-endian bytes, see rsp_tcp_unpack(). n is a multiple of
+ * RSP_TCP_PACKED_GROUP_SAMPLES.
+ */
+
+CONVERT_INLINE int packed_component(short x, int bits)
+{
+	int v = x >> (14 - bits);
+
+	if (v > (1 << (bits - 1)) - 1) {
+		v = (1 << (bits - 1)) - 1;
+	}
+	else if (v < -(1 << (bits - 1))) {
+		v = -(1 << (bits - 1));
+	}
+
+	return v & ((1 << bits) - 1);
+}
+
+CONVERT_INLINE void packed_scalar(unsigned char *out, const short *xi, const short *xq, unsigned int n, int bits)
+{
+	unsigned long long group;
+	unsigned int i, k;
+
+	for (i = 0; i < n; i += RSP_TCP_PACKED_GROUP_SAMPLES)
+	{
+		group = (unsigned long long)packed_component(xi[i], bits) |
+			(unsigned long long)packed_component(xq[i], bits) << bits |
+			(unsigned long long)packed_component(xi[i + 1], bits) << (2 * bits) |
+			(unsigned long long)packed_component(xq[i + 1], bits) << (3 * bits);
+
+		for (k = 0; k < (unsigned int)bits / 2; k++) {
+			*(out++) = (unsigned char)(group >> (8 * k));
+		}
+	}
+}
+
+/*
+ * Block floating point: per block of RSP_TCP_BFP_BLOCK_SAMPLES the exponent
+ * is the smallest shift that fits every component into a bits-wide mantissa,
+ * what sample_shift does with a fixed value. ORing x ^ (x >> 15) over the
+ * block gives a word with the bit length of the largest magnitude, which
+ * needs no compare and vectorizes to a plain OR. Mantissas are rounded to
+ * nearest like the 8-bit format, a component that rounds up past the top
+ * of the mantissa range saturates.
+ */
+
+CONVERT_INLINE int bfp_exponent(int peak, int bits)
+{
+	int e = 0;
+
+	while ((peak >> e) > (1 << (bits - 1)) - 1) {
+		e++;
+	}
+
+	return e;
+}
+
+CONVERT_INLINE signed char bfp_mantissa(short x, int e, int bits)
+{
+	int v = (x + ((1 << e) >> 1)) >> e;
+
+	if (v > (1 << (bits - 1)) - 1) {
+		v = (1 << (bits - 1)) - 1;
+	}
+	else if (v < -(1 << (bits - 1))) {
+		v = -(1 << (bits - 1));
+	}
+
+	return (signed char)v;
+}
+
+// 6-bit mantissas go four to three bytes, LSB first
+CONVERT_INLINE void bfp6_pack(unsigned char *out, const signed char *m)
+{
+	unsigned int group;
+	unsigned int k;
+
+	for (k = 0; k < 2 * RSP_TCP_BFP_BLOCK_SAMPLES; k += 4) {
+		group = (m[k] & 0x3fu) | (m[k + 1] & 0x3fu) << 6 | (m[k + 2] & 0x3fu) << 12 | (m[k + 3] & 0x3fu) << 18;
+		*(out++) = (unsigned char)group;
+		*(out++) = (unsigned char)(group >> 8);
+		*(out++) = (unsigned char)(group >> 16);
+	}
+}
+
+CONVERT_INLINE void bfp_scalar(unsigned char *out, const short *xi, const short *xq, unsigned int n, int bits)
+{
+	signed char m[2 * RSP_TCP_BFP_BLOCK_SAMPLES];
+	signed char *dst;
+	unsigned int i, k;
+	int peak, e;
+
+	for (i = 0; i < n; i += RSP_TCP_BFP_BLOCK_SAMPLES, xi += RSP_TCP_BFP_BLOCK_SAMPLES, xq += RSP_TCP_BFP_BLOCK_SAMPLES)
+	{
+		peak = 0;
+		for (k = 0; k < RSP_TCP_BFP_BLOCK_SAMPLES; k++) {
+			peak |= (xi[k] ^ (xi[k] >> 15)) | (xq[k] ^ (xq[k] >> 15));
+		}
+
+		e = bfp_exponent(peak & 0x7fff, bits);
+		*(out++) = (unsigned char)e;
+
+		dst = bits == 8 ? (signed char *)out : m;
+		for (k = 0; k < RSP_TCP_BFP_BLOCK_SAMPLES; k++) {
+			*(dst++) = bfp_mantissa(xi[k], e, bits);
+			*(dst++) = bfp_mantissa(xq[k], e, bits);
+		}
+
+		if (bits == 8) {
+			out += 2 * RSP_TCP_BFP_BLOCK_SAMPLES;
+		}
+		else {
+			bfp6_pack(out, m);
+			out += 2 * RSP_TCP_BFP_BLOCK_SAMPLES * 6 / 8;
+		}
+	}
+}
+
+// x ^ (x >> 15) ORed over the block, see bfp_exponent()
+CONVERT_INLINE int peak_scalar(const short *xi, const short *xq, unsigned int n)
+{
+	unsigned int i;
+	int peak = 0;
+
+	for (i = 0; i < n; i++) {
+		peak |= (xi[i] ^ (xi[i] >> 15)) | (xq[i] ^ (xq[i] >> 15));
+	}
+
+	return peak & 0x7fff;
+}
+
+// sum of the squares of both components, exact in 64 bits for any block the server hands over
+CONVERT_INLINE unsigned long long power_scalar(const short *xi, const short *xq, unsigned int n)
+{
+	unsigned long long power = 0;
+	unsigned int i;
+
+	for (i = 0; i < n; i++) {
+		power += (unsigned int)(xi[i] * xi[i]) + (unsigned int)(xq[i] * xq[i]);
+	}
+
+	return power;
+}
+
+/*
+ * The 8-bit vector kernels round with a saturating add of half an output LSB
+ * (plus the dither) and an arithmetic shift. The add can only saturate where
+ * the result is clamped to the int8 range anyway, so they match the scalar
+ * code. Left shifts clamp first so the 16-bit lanes cannot wrap. I lands in
+ * the low byte and Q in the high byte of each output word, so a
+ * little-endian store gives the I/Q interleave without any shuffling, and
+ * the 128 offset is an xor with 0x80.
+ */
+
+#ifdef CONVERT_X86
+CONVERT_TARGET("sse2")
+CONVERT_INLINE __m128i dither_step_sse2(__m128i x)
+{
+	x = _mm_xor_si128(x, _mm_slli_epi32(x, 13));
+	x = _mm_xor_si128(x, _mm_srli_epi32(x, 17));
+	return _mm_xor_si128(x, _mm_slli_epi32(x, 5));
+}
+
+// dither for 8 samples from lanes 0-3 and 4-7, see dither_value()
+CONVERT_TARGET("sse2")
+CONVERT_INLINE __m128i dither_values_sse2(__m128i lo, __m128i hi, int m)
+{
+	lo = _mm_sub_epi32(_mm_srli_epi32(_mm_slli_epi32(lo, 16), 32 - m), _mm_srli_epi32(lo, 32 - m));
+	hi = _mm_sub_epi32(_mm_srli_epi32(_mm_slli_epi32(hi, 16), 32 - m), _mm_srli_epi32(hi, 32 - m));
+	return _mm_packs_epi32(lo, hi);
+}
+
+CONVERT_TARGET("sse2")
+CONVERT_INLINE __m128i requantize_sse2(__m128i x, int shift, __m128i d)
+{
+	__m128i lo = _mm_set1_epi16(-128);
+	__m128i hi = _mm_set1_epi16(127);
+
+	if (shift < 8) {
+		x = _mm_adds_epi16(x, _mm_add_epi16(d, _mm_set1_epi16((short)(1 << (7 - shift)))));
+		x = _mm_srai_epi16(x, 8 - shift);
+	}
+	else {
+		x = _mm_slli_epi16(_mm_min_epi16(_mm_max_epi16(x, lo), hi), shift - 8);
+	}
+
+	return _mm_min_epi16(_mm_max_epi16(x, lo), hi);
+}
+
+CONVERT_TARGET("sse2")
+CONVERT_INLINE void uint8_sse2(unsigned char *out, const short *xi, const short *xq, unsigned int n, int shift, int dither)
+{
+	__m128i low = _mm_set1_epi16(0xff);
+	__m128i bias = _mm_set1_epi16((short)0x8080);
+	__m128i s0, s1, di, dq, i, q;
+	unsigned int k;
+
+	dither = dither && shift < 8;
+	di = dq = _mm_setzero_si128();
+	s0 = _mm_loadu_si128((const __m128i *)dither_lanes);
+	s1 = _mm_loadu_si128((const __m128i *)(dither_lanes + 4));
+
+	for (k = 0; k + 8 <= n; k += 8) {
+		if (dither) {
+			s0 = dither_step_sse2(s0);
+			s1 = dither_step_sse2(s1);
+			di = dither_values_sse2(s0, s1, 8 - shift);
+			s0 = dither_step_sse2(s0);
+			s1 = dither_step_sse2(s1);
+			dq = dither_values_sse2(s0, s1, 8 - shift);
+		}
+
+		i = requantize_sse2(_mm_loadu_si128((const __m128i *)(xi + k)), shift, di);
+		q = requantize_sse2(_mm_loadu_si128((const __m128i *)(xq + k)), shift, dq);
+		i = _mm_or_si128(_mm_and_si128(i, low), _mm_slli_epi16(q, 8));
+		_mm_storeu_si128((__m128i *)(out + 2 * k), _mm_xor_si128(i, bias));
+	}
+
+	if (dither) {
+		_mm_storeu_si128((__m128i *)dither_lanes, s0);
+		_mm_storeu_si128((__m128i *)(dither_lanes + 4), s1);
+	}
+
+	uint8_scalar(out + 2 * k, xi + k, xq + k, n - k, shift, dither);
+}
+
+CONVERT_TARGET("sse2")
+CONVERT_INLINE void int16_sse2(short *out, const short *xi, const short *xq, unsigned int n)
+{
+	__m128i i, q;
+	unsigned int k;
+
+	for (k = 0; k + 8 <= n; k += 8) {
+		i = _mm_loadu_si128((const __m128i *)(xi + k));
+		q = _mm_loadu_si128((const __m128i *)(xq + k));
+		_mm_storeu_si128((__m128i *)(out + 2 * k), _mm_unpacklo_epi16(i, q));
+		_mm_storeu_si128((__m128i *)(out + 2 * k + 8), _mm_unpackhi_epi16(i, q));
+	}
+
+	int16_scalar(out + 2 * k, xi + k, xq + k, n - k);
+}
+
+CONVERT_TARGET("sse2")
+CONVERT_INLINE void float32_sse2(float *out, const short *xi, const short *xq, unsigned int n)
+{
+	__m128 scale = _mm_set1_ps(CONVERT_FLOAT32_SCALE);
+	__m128i i, q, iq;
+	unsigned int k;
+
+	for (k = 0; k + 8 <= n; k += 8) {
+		i = _mm_loadu_si128((const __m128i *)(xi + k));
+		q = _mm_loadu_si128((const __m128i *)(xq + k));
+
+		// interleave, then sign extend each half to 32 bits by shifting it in from the top
+		iq = _mm_unpacklo_epi16(i, q);
+		_mm_storeu_ps(out + 2 * k, _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(iq, iq), 16)), scale));
+		_mm_storeu_ps(out + 2 * k + 4, _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(iq, iq), 16)), scale));
+		iq = _mm_unpackhi_epi16(i, q);
+		_mm_storeu_ps(out + 2 * k + 8, _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(iq, iq), 16)), scale));
+		_mm_storeu_ps(out + 2 * k + 12, _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(iq, iq), 16)), scale));
+	}
+
+	float32_scalar(out + 2 * k, xi + k, xq + k, n - k);
+}
+
+// four interleaved components per 64-bit lane in, one packed group per lane out
+CONVERT_TARGET("sse2")
+CONVERT_INLINE __m128i packed_groups_sse2(__m128i iq, int bits)
+{
+	__m128i low = _mm_set_epi32(0, -1, 0, -1);
+
+	iq = _mm_srai_epi16(iq, 14 - bits);
+	iq = _mm_min_epi16(_mm_max_epi16(iq, _mm_set1_epi16((short)-(1 << (bits - 1)))), _mm_set1_epi16((short)((1 << (bits - 1)) - 1)));
+	iq = _mm_and_si128(iq, _mm_set1_epi16((short)((1 << bits) - 1)));
+
+	// the components are now positive, so madd puts each pair side by side in 32 bits
+	iq = _mm_madd_epi16(iq, _mm_set1_epi32(1 << (16 + bits) | 1));
+	return _mm_or_si128(_mm_and_si128(iq, low), _mm_srli_epi64(_mm_andnot_si128(low, iq), 32 - 2 * bits));
+}
+
+CONVERT_TARGET("sse2")
+CONVERT_INLINE void packed_sse2(unsigned char *out, const short *xi, const short *xq, unsigned int n, int bits)
+{
+	__m128i i, q, g;
+	unsigned int k;
+
+	// each group is stored as 8 bytes and the next one overwrites the excess,
+	// so the last group of the frame is always left to the scalar loop
+	for (k = 0; k + 8 < n; k += 8) {
+		i = _mm_loadu_si128((const __m128i *)(xi + k));
+		q = _mm_loadu_si128((const __m128i *)(xq + k));
+
+		g = packed_groups_sse2(_mm_unpacklo_epi16(i, q), bits);
+		_mm_storel_epi64((__m128i *)out, g);
+		_mm_storel_epi64((__m128i *)(out + bits / 2), _mm_unpackhi_epi64(g, g));
+		g = packed_groups_sse2(_mm_unpackhi_epi16(i, q), bits);
+		_mm_storel_epi64((__m128i *)(out + bits), g);
+		_mm_storel_epi64((__m128i *)(out + 3 * bits / 2), _mm_unpackhi_epi64(g, g));
+		out += 2 * bits;
+	}
+
+	packed_scalar(out, xi + k, xq + k, n - k, bits);
+}
+
+CONVERT_TARGET("sse2")
+CONVERT_INLINE void bfp_sse2(unsigned char *out, const short *xi, const short *xq, unsigned int n, int bits)
+{
+	__m128i i[RSP_TCP_BFP_BLOCK_SAMPLES / 8], q[RSP_TCP_BFP_BLOCK_SAMPLES / 8];
+	__m128i peak, count, half, lo, hi, si, sq;
+	signed char m[2 * RSP_TCP_BFP_BLOCK_SAMPLES];
+	unsigned char *dst;
+	unsigned int b, k;
+	int e;
+
+	lo = _mm_set1_epi16((short)-(1 << (bits - 1)));
+	hi = _mm_set1_epi16((short)((1 << (bits - 1)) - 1));
+
+	for (b = 0; b < n; b += RSP_TCP_BFP_BLOCK_SAMPLES) {
+		peak = _mm_setzero_si128();
+		for (k = 0; k < RSP_TCP_BFP_BLOCK_SAMPLES / 8; k++) {
+			i[k] = _mm_loadu_si128((const __m128i *)(xi + b + 8 * k));
+			q[k] = _mm_loadu_si128((const __m128i *)(xq + b + 8 * k));
+			peak = _mm_or_si128(peak, _mm_xor_si128(i[k], _mm_srai_epi16(i[k], 15)));
+			peak = _mm_or_si128(peak, _mm_xor_si128(q[k], _mm_srai_epi16(q[k], 15)));
+		}
+		peak = _mm_or_si128(peak, _mm_srli_si128(peak, 8));
+		peak = _mm_or_si128(peak, _mm_srli_si128(peak, 4));
+		peak = _mm_or_si128(peak, _mm_srli_si128(peak, 2));
+
+		e = bfp_exponent(_mm_cvtsi128_si32(peak) & 0x7fff, bits);
+		count = _mm_cvtsi32_si128(e);
+		half = _mm_set1_epi16((short)((1 << e) >> 1));
+		*(out++) = (unsigned char)e;
+
+		// the rounding add can only saturate where the clamp does anyway, after
+		// the clamp the saturating pack is a plain narrowing
+		dst = bits == 8 ? out : (unsigned char *)m;
+		for (k = 0; k < RSP_TCP_BFP_BLOCK_SAMPLES / 8; k++) {
+			si = _mm_sra_epi16(_mm_adds_epi16(i[k], half), count);
+			sq = _mm_sra_epi16(_mm_adds_epi16(q[k], half), count);
+			si = _mm_min_epi16(_mm_max_epi16(si, lo), hi);
+			sq = _mm_min_epi16(_mm_max_epi16(sq, lo), hi);
+			_mm_storeu_si128((__m128i *)(dst + 16 * k), _mm_packs_epi16(_mm_unpacklo_epi16(si, sq), _mm_unpackhi_epi16(si, sq)));
+		}
+
+		if (bits == 8) {
+			out += 2 * RSP_TCP_BFP_BLOCK_SAMPLES;
+		}
+		else {
+			bfp6_pack(out, m);
+			out += 2 * RSP_TCP_BFP_BLOCK_SAMPLES * 6 / 8;
+		}
+	}
+}
+
+CONVERT_TARGET("sse2")
+CONVERT_INLINE int peak_sse2(const short *xi, const short *xq, unsigned int n)
+{
+	__m128i peak = _mm_setzero_si128();
+	__m128i i, q;
+	unsigned int k;
+
+	for (k = 0; k + 8 <= n; k += 8) {
+		i = _mm_loadu_si128((const __m128i *)(xi + k));
+		q = _mm_loadu_si128((const __m128i *)(xq + k));
+		peak = _mm_or_si128(peak, _mm_xor_si128(i, _mm_srai_epi16(i, 15)));
+		peak = _mm_or_si128(peak, _mm_xor_si128(q, _mm_srai_epi16(q, 15)));
+	}
+	peak = _mm_or_si128(peak, _mm_srli_si128(peak, 8));
+	peak = _mm_or_si128(peak, _mm_srli_si128(peak, 4));
+	peak = _mm_or_si128(peak, _mm_srli_si128(peak, 2));
+
+	return (_mm_cvtsi128_si32(peak) & 0x7fff) | peak_scalar(xi + k, xq + k, n - k);
+}
+
+// a pair of squares is at most 2^31, so the 32-bit sums are widened as unsigned before they add up
+CONVERT_TARGET("sse2")
+CONVERT_INLINE unsigned long long power_sse2(const short *xi, const short *xq, unsigned int n)
+{
+	__m128i zero = _mm_setzero_si128();
+	__m128i power = _mm_setzero_si128();
+	__m128i i, q;
+	unsigned long long lanes[2];
+	unsigned int k;
+
+	for (k = 0; k + 8 <= n; k += 8) {
+		i = _mm_loadu_si128((const __m128i *)(xi + k));
+		q = _mm_loadu_si128((const __m128i *)(xq + k));
+		i = _mm_madd_epi16(i, i);
+		q = _mm_madd_epi16(q, q);
+		power = _mm_add_epi64(power, _mm_unpacklo_epi32(i, zero));
+		power = _mm_add_epi64(power, _mm_unpackhi_epi32(i, zero));
+		power = _mm_add_epi64(power, _mm_unpacklo_epi32(q, zero));
+		power = _mm_add_epi64(power, _mm_unpackhi_epi32(q, zero));
+	}
+	_mm_storeu_si128((__m128i *)lanes, power);
+
+	return lanes[0] + lanes[1] + power_scalar(xi + k, xq + k, n - k);
+}
+
+CONVERT_TARGET("avx2")
+CONVERT_INLINE __m256i requantize_avx2(__m256i x, int shift)
+{
+	__m256i lo = _mm256_set1_epi16(-128);
+	__m256i hi = _mm256_set1_epi16(127);
+
+	if (shift < 8) {
+		x = _mm256_srai_epi16(_mm256_adds_epi16(x, _mm256_set1_epi16((short)(1 << (7 - shift)))), 8 - shift);
+	}
+	else {
+		x = _mm256_slli_epi16(_mm256_min_epi16(_mm256_max_epi16(x, lo), hi), shift - 8);
+	}
+
+	return _mm256_min_epi16(_mm256_max_epi16(x, lo), hi);
+}
+
+CONVERT_TARGET("avx2")
+CONVERT_INLINE void uint8_avx2(unsigned char *out, const short *xi, const short *xq, unsigned int n, int shift, int dither)
+{
+	__m256i low = _mm256_set1_epi16(0xff);
+	__m256i bias = _mm256_set1_epi16((short)0x8080);
+	__m256i i, q;
+	unsigned int k = 0;
+
+	// the dither generators are laid out for 128-bit vectors
+	if (!dither || shift >= 8) {
+		for (; k + 16 <= n; k += 16) {
+			i = requantize_avx2(_mm256_loadu_si256((const __m256i *)(xi + k)), shift);
+			q = requantize_avx2(_mm256_loadu_si256((const __m256i *)(xq + k)), shift);
+			i = _mm256_or_si256(_mm256_and_si256(i, low), _mm256_slli_epi16(q, 8));
+			_mm256_storeu_si256((__m256i *)(out + 2 * k), _mm256_xor_si256(i, bias));
+		}
+	}
+
+	uint8_sse2(out + 2 * k, xi + k, xq + k, n - k, shift, dither);
+}
+
+CONVERT_TARGET("avx2")
+CONVERT_INLINE int peak_avx2(const short *xi, const short *xq, unsigned int n)
+{
+	__m256i peak = _mm256_setzero_si256();
+	__m256i i, q;
+	__m128i p;
+	unsigned int k;
+
+	for (k = 0; k + 16 <= n; k += 16) {
+		i = _mm256_loadu_si256((const __m256i *)(xi + k));
+		q = _mm256_loadu_si256((const __m256i *)(xq + k));
+		peak = _mm256_or_si256(peak, _mm256_xor_si256(i, _mm256_srai_epi16(i, 15)));
+		peak = _mm256_or_si256(peak, _mm256_xor_si256(q, _mm256_srai_epi16(q, 15)));
+	}
+	p = _mm_or_si128(_mm256_castsi256_si128(peak), _mm256_extracti128_si256(peak, 1));
+	p = _mm_or_si128(p, _mm_srli_si128(p, 8));
+	p = _mm_or_si128(p, _mm_srli_si128(p, 4));
+	p = _mm_or_si128(p, _mm_srli_si128(p, 2));
+
+	return (_mm_cvtsi128_si32(p) & 0x7fff) | peak_sse2(xi + k, xq + k, n - k);
+}
+
+CONVERT_TARGET("avx2")
+CONVERT_INLINE unsigned long long power_avx2(const short *xi, const short *xq, unsigned int n)
+{
+	__m256i zero = _mm256_setzero_si256();
+	__m256i power = _mm256_setzero_si256();
+	__m256i i, q;
+	unsigned long long lanes[2];
+	__m128i p;
+	unsigned int k;
+
+	for (k = 0; k + 16 <= n; k += 16) {
+		i = _mm256_loadu_si256((const __m256i *)(xi + k));
+		q = _mm256_loadu_si256((const __m256i *)(xq + k));
+		i = _mm256_madd_epi16(i, i);
+		q = _mm256_madd_epi16(q, q);
+		power = _mm256_add_epi64(power, _mm256_unpacklo_epi32(i, zero));
+		power = _mm256_add_epi64(power, _mm256_unpackhi_epi32(i, zero));
+		power = _mm256_add_epi64(power, _mm256_unpacklo_epi32(q, zero));
+		power = _mm256_add_epi64(power, _mm256_unpackhi_epi32(q, zero));
+	}
+	p = _mm_add_epi64(_mm256_castsi256_si128(power), _mm256_extracti128_si256(power, 1));
+	_mm_storeu_si128((__m128i *)lanes, p);
+
+	return lanes[0] + lanes[1] + power_sse2(xi + k, xq + k, n - k);
+}
+
+CONVERT_TARGET("avx2")
+CONVERT_INLINE void int16_avx2(short *out, const short *xi, const short *xq, unsigned int n)
+{
+	__m256i i, q, lo, hi;
+	unsigned int k;
+
+	for (k = 0; k + 16 <= n; k += 16) {
+		i = _mm256_loadu_si256((const __m256i *)(xi + k));
+		q = _mm256_loadu_si256((const __m256i *)(xq + k));
+
+		// the unpacks work per 128-bit lane, put the halves back in order
+		lo = _mm256_unpacklo_epi16(i, q);
+		hi = _mm256_unpackhi_epi16(i, q);
+		_mm256_storeu_si256((__m256i *)(out + 2 * k), _mm256_permute2x128_si256(lo, hi, 0x20));
+		_mm256_storeu_si256((__m256i *)(out + 2 * k + 16), _mm256_permute2x128_si256(lo, hi, 0x31));
+	}
+
+	int16_sse2(out + 2 * k, xi + k, xq + k, n - k);
+}
+
+CONVERT_TARGET("avx2")
+CONVERT_INLINE void float32_avx2(float *out, const short *xi, const short *xq, unsigned int n)
+{
+	__m256 scale = _mm256_set1_ps(CONVERT_FLOAT32_SCALE);
+	__m256i i, q, lo, hi, iq;
+	unsigned int k;
+
+	for (k = 0; k + 16 <= n; k += 16) {
+		i = _mm256_loadu_si256((const __m256i *)(xi + k));
+		q = _mm256_loadu_si256((const __m256i *)(xq + k));
+		lo = _mm256_unpacklo_epi16(i, q);
+		hi = _mm256_unpackhi_epi16(i, q);
+
+		iq = _mm256_permute2x128_si256(lo, hi, 0x20);
+		_mm256_storeu_ps(out + 2 * k, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm256_castsi256_si128(iq))), scale));
+		_mm256_storeu_ps(out + 2 * k + 8, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm256_extracti128_si256(iq, 1))), scale));
+		iq = _mm256_permute2x128_si256(lo, hi, 0x31);
+		_mm256_storeu_ps(out + 2 * k + 16, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm256_castsi256_si128(iq))), scale));
+		_mm256_storeu_ps(out + 2 * k + 24, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm256_extracti128_si256(iq, 1))), scale));
+	}
+
+	float32_sse2(out + 2 * k, xi + k, xq + k, n - k);
+}
+
+// the 128-bit lane split of the unpacks costs more than it saves here
+CONVERT_TARGET("avx2")
+CONVERT_INLINE void packed_avx2(unsigned char *out, const short *xi, const short *xq, unsigned int n, int bits)
+{
+	packed_sse2(out, xi, xq, n, bits);
+}
+
+// a block is only four SSE2 vectors per component
+CONVERT_TARGET("avx2")
+CONVERT_INLINE void bfp_avx2(unsigned char *out, const short *xi, const short *xq, unsigned int n, int bits)
+{
+	bfp_sse2(out, xi, xq, n, bits);
+}
+
+static int cpu_has_avx2(void)
+{
+#ifdef _MSC_VER
+	int info[4];
+
+	__cpuid(info, 0);
+	if (info[0] < 7) {
+		return 0;
+	}
+
+	// AVX and OSXSAVE, then the OS must save the ymm state
+	__cpuid(info, 1);
+	if ((info[2] & (1 << 27)) == 0 || (info[2] & (1 << 28)) == 0) {
+		return 0;
+	}
+	if ((_xgetbv(0) & 6) != 6) {
+		return 0;
+	}
+
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2");
+#endif
+}
+
+static int cpu_has_sse2(void)
+{
+#if defined(__x86_64__) || defined(_M_X64)
+	return 1;
+#elif defined(_MSC_VER)
+	int info[4];
+
+	__cpuid(info, 1);
+	return (info[3] & (1 << 26)) != 0;
+#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("sse2");
+#endif
+}
+#endif
+
+#ifdef CONVERT_NEON
+CONVERT_INLINE uint32x4_t dither_step_neon(uint32x4_t x)
+{
+	x = veorq_u32(x, vshlq_n_u32(x, 13));
+	x = veorq_u32(x, vshrq_n_u32(x, 17));
+	return veorq_u32(x, vshlq_n_u32(x, 5));
+}
+
+CONVERT_INLINE int16x8_t dither_values_neon(uint32x4_t lo, uint32x4_t hi, int m)
+{
+	int32x4_t count = vdupq_n_s32(m - 32);
+	int32x4_t a, b;
+
+	a = vsubq_s32(vreinterpretq_s32_u32(vshlq_u32(vshlq_n_u32(lo, 16), count)), vreinterpretq_s32_u32(vshlq_u32(lo, count)));
+	b = vsubq_s32(vreinterpretq_s32_u32(vshlq_u32(vshlq_n_u32(hi, 16), count)), vreinterpretq_s32_u32(vshlq_u32(hi, count)));
+	return vcombine_s16(vmovn_s32(a), vmovn_s32(b));
+}
+
+// same steps as requantize_sse2(), a negative count shifts right
+CONVERT_INLINE int8x8_t requantize_neon(int16x8_t x, int shift, int16x8_t d)
+{
+	int16x8_t lo = vdupq_n_s16(-128);
+	int16x8_t hi = vdupq_n_s16(127);
+
+	if (shift < 8) {
+		x = vqaddq_s16(x, vaddq_s16(d, vdupq_n_s16((short)(1 << (7 - shift)))));
+		x = vshlq_s16(x, vdupq_n_s16((short)(shift - 8)));
+	}
+	else {
+		x = vshlq_s16(vminq_s16(vmaxq_s16(x, lo), hi), vdupq_n_s16((short)(shift - 8)));
+	}
+
+	return vmovn_s16(vminq_s16(vmaxq_s16(x, lo), hi));
+}
+
+CONVERT_INLINE void uint8_neon(unsigned char *out, const short *xi, const short *xq, unsigned int n, int shift, int dither)
+{
+	int8x8_t bias = vdup_n_s8(-128);
+	int16x8_t di, dq;
+	uint32x4_t s0, s1;
+	int8x8x2_t iq;
+	unsigned int k;
+
+	dither = dither && shift < 8;
+	di = dq = vdupq_n_s16(0);
+	s0 = vld1q_u32(dither_lanes);
+	s1 = vld1q_u32(dither_lanes + 4);
+
+	// vst2 does the interleave as part of the store
+	for (k = 0; k + 8 <= n; k += 8) {
+		if (dither) {
+			s0 = dither_step_neon(s0);
+			s1 = dither_step_neon(s1);
+			di = dither_values_neon(s0, s1, 8 - shift);
+			s0 = dither_step_neon(s0);
+			s1 = dither_step_neon(s1);
+			dq = dither_values_neon(s0, s1, 8 - shift);
+		}
+
+		iq.val[0] = veor_s8(requantize_neon(vld1q_s16(xi + k), shift, di), bias);
+		iq.val[1] = veor_s8(requantize_neon(vld1q_s16(xq + k), shift, dq), bias);
+		vst2_s8((int8_t *)(out + 2 * k), iq);
+	}
+
+	if (dither) {
+		vst1q_u32(dither_lanes, s0);
+		vst1q_u32(dither_lanes + 4, s1);
+	}
+
+	uint8_scalar(out + 2 * k, xi + k, xq + k, n - k, shift, dither);
+}
+
+CONVERT_INLINE void int16_neon(short *out, const short *xi, const short *xq, unsigned int n)
+{
+	int16x8x2_t iq;
+	unsigned int k;
+
+	// vst2 does the interleave as part of the store
+	for (k = 0; k + 8 <= n; k += 8) {
+		iq.val[0] = vld1q_s16(xi + k);
+		iq.val[1] = vld1q_s16(xq + k);
+		vst2q_s16(out + 2 * k, iq);
+	}
+
+	int16_scalar(out + 2 * k, xi + k, xq + k, n - k);
+}
+
+CONVERT_INLINE void float32_neon(float *out, const short *xi, const short *xq, unsigned int n)
+{
+	int16x8_t i, q;
+	float32x4x2_t iq;
+	unsigned int k;
+
+	for (k = 0; k + 8 <= n; k += 8) {
+		i = vld1q_s16(xi + k);
+		q = vld1q_s16(xq + k);
+
+		iq.val[0] = vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(i))), CONVERT_FLOAT32_SCALE);
+		iq.val[1] = vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(q))), CONVERT_FLOAT32_SCALE);
+		vst2q_f32(out + 2 * k, iq);
+		iq.val[0] = vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(i))), CONVERT_FLOAT32_SCALE);
+		iq.val[1] = vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(q))), CONVERT_FLOAT32_SCALE);
+		vst2q_f32(out + 2 * k + 8, iq);
+	}
+
+	float32_scalar(out + 2 * k, xi + k, xq + k, n - k);
+}
+
+CONVERT_INLINE uint64x2_t packed_groups_neon(int16x8_t iq, int bits)
+{
+	uint32x4_t pair;
+	uint64x2_t group;
+
+	// a negative count shifts right, arithmetic for signed lanes
+	iq = vshlq_s16(iq, vdupq_n_s16((short)(bits - 14)));
+	iq = vminq_s16(vmaxq_s16(iq, vdupq_n_s16((short)-(1 << (bits - 1)))), vdupq_n_s16((short)((1 << (bits - 1)) - 1)));
+	pair = vreinterpretq_u32_u16(vandq_u16(vreinterpretq_u16_s16(iq), vdupq_n_u16((unsigned short)((1 << bits) - 1))));
+
+	pair = vorrq_u32(vandq_u32(pair, vdupq_n_u32(0xffff)), vshlq_u32(vshrq_n_u32(pair, 16), vdupq_n_s32(bits)));
+	group = vreinterpretq_u64_u32(pair);
+	return vorrq_u64(vandq_u64(group, vdupq_n_u64(0xffffffff)), vshlq_u64(vshrq_n_u64(group, 32), vdupq_n_s64(2 * bits)));
+}
+
+CONVERT_INLINE void packed_neon(unsigned char *out, const short *xi, const short *xq, unsigned int n, int bits)
+{
+	int16x8x2_t iq;
+	uint64x2_t g;
+	unsigned int k;
+
+	// same overlapping stores as the SSE2 variant
+	for (k = 0; k + 8 < n; k += 8) {
+		iq = vzipq_s16(vld1q_s16(xi + k), vld1q_s16(xq + k));
+
+		g = packed_groups_neon(iq.val[0], bits);
+		vst1_u8(out, vreinterpret_u8_u64(vget_low_u64(g)));
+		vst1_u8(out + bits / 2, vreinterpret_u8_u64(vget_high_u64(g)));
+		g = packed_groups_neon(iq.val[1], bits);
+		vst1_u8(out + bits, vreinterpret_u8_u64(vget_low_u64(g)));
+		vst1_u8(out + 3 * bits / 2, vreinterpret_u8_u64(vget_high_u64(g)));
+		out += 2 * bits;
+	}
+
+	packed_scalar(out, xi + k, xq + k, n - k, bits);
+}
+
+CONVERT_INLINE void bfp_neon(unsigned char *out, const short *xi, const short *xq, unsigned int n, int bits)
+{
+	int16x8_t i[RSP_TCP_BFP_BLOCK_SAMPLES / 8], q[RSP_TCP_BFP_BLOCK_SAMPLES / 8];
+	int16x8_t peak, count, half, lo, hi, si, sq;
+	int16x4_t p;
+	int16x8x2_t iq;
+	signed char m[2 * RSP_TCP_BFP_BLOCK_SAMPLES];
+	unsigned char *dst;
+	unsigned int b, k;
+	int e;
+
+	lo = vdupq_n_s16((short)-(1 << (bits - 1)));
+	hi = vdupq_n_s16((short)((1 << (bits - 1)) - 1));
+
+	for (b = 0; b < n; b += RSP_TCP_BFP_BLOCK_SAMPLES) {
+		peak = vdupq_n_s16(0);
+		for (k = 0; k < RSP_TCP_BFP_BLOCK_SAMPLES / 8; k++) {
+			i[k] = vld1q_s16(xi + b + 8 * k);
+			q[k] = vld1q_s16(xq + b + 8 * k);
+			peak = vorrq_s16(peak, veorq_s16(i[k], vshrq_n_s16(i[k], 15)));
+			peak = vorrq_s16(peak, veorq_s16(q[k], vshrq_n_s16(q[k], 15)));
+		}
+		p = vorr_s16(vget_low_s16(peak), vget_high_s16(peak));
+		e = bfp_exponent((vget_lane_s16(p, 0) | vget_lane_s16(p, 1) | vget_lane_s16(p, 2) | vget_lane_s16(p, 3)) & 0x7fff, bits);
+		*(out++) = (unsigned char)e;
+
+		count = vdupq_n_s16((short)-e);
+		half = vdupq_n_s16((short)((1 << e) >> 1));
+		dst = bits == 8 ? out : (unsigned char *)m;
+		for (k = 0; k < RSP_TCP_BFP_BLOCK_SAMPLES / 8; k++) {
+			// same rounding and clamp as the SSE2 variant
+			si = vminq_s16(vmaxq_s16(vshlq_s16(vqaddq_s16(i[k], half), count), lo), hi);
+			sq = vminq_s16(vmaxq_s16(vshlq_s16(vqaddq_s16(q[k], half), count), lo), hi);
+			iq = vzipq_s16(si, sq);
+			vst1q_s8((int8_t *)(dst + 16 * k), vcombine_s8(vmovn_s16(iq.val[0]), vmovn_s16(iq.val[1])));
+		}
+
+		if (bits == 8) {
+			out += 2 * RSP_TCP_BFP_BLOCK_SAMPLES;
+		}
+		else {
+			bfp6_pack(out, m);
+			out += 2 * RSP_TCP_BFP_BLOCK_SAMPLES * 6 / 8;
+		}
+	}
+}
+
+CONVERT_INLINE int peak_neon(const short *xi, const short *xq, unsigned int n)
+{
+	int16x8_t peak = vdupq_n_s16(0);
+	int16x8_t i, q;
+	int16x4_t p;
+	unsigned int k;
+
+	for (k = 0; k + 8 <= n; k += 8) {
+		i = vld1q_s16(xi + k);
+		q = vld1q_s16(xq + k);
+		peak = vorrq_s16(peak, veorq_s16(i, vshrq_n_s16(i, 15)));
+		peak = vorrq_s16(peak, veorq_s16(q, vshrq_n_s16(q, 15)));
+	}
+	p = vorr_s16(vget_low_s16(peak), vget_high_s16(peak));
+
+	return ((vget_lane_s16(p, 0) | vget_lane_s16(p, 1) | vget_lane_s16(p, 2) | vget_lane_s16(p, 3)) & 0x7fff) |
+		peak_scalar(xi + k, xq + k, n - k);
+}
+
+CONVERT_INLINE unsigned long long power_neon(const short *xi, const short *xq, unsigned int n)
+{
+	uint64x2_t power = vdupq_n_u64(0);
+	int16x8_t i, q;
+	unsigned int k;
+
+	for (k = 0; k + 8 <= n; k += 8) {
+		i = vld1q_s16(xi + k);
+		q = vld1q_s16(xq + k);
+		power = vpadalq_u32(power, vreinterpretq_u32_s32(vmull_s16(vget_low_s16(i), vget_low_s16(i))));
+		power = vpadalq_u32(power, vreinterpretq_u32_s32(vmull_s16(vget_high_s16(i), vget_high_s16(i))));
+		power = vpadalq_u32(power, vreinterpretq_u32_s32(vmull_s16(vget_low_s16(q), vget_low_s16(q))));
+		power = vpadalq_u32(power, vreinterpretq_u32_s32(vmull_s16(vget_high_s16(q), vget_high_s16(q))));
+	}
+
+	return vgetq_lane_u64(power, 0) + vgetq_lane_u64(power, 1) + power_scalar(xi + k, xq + k, n - k);
+}
+
+static int cpu_has_neon(void)
+{
+#if defined(__linux__) && !defined(__aarch64__)
+	return (getauxval(AT_HWCAP) & HWCAP_NEON) != 0;
+#else
+	return 1;
+#endif
+}
+#endif
+
+/*
+ * Generated kernels: convert_uint8_<isa>_<shift>, the dithered
+ * convert_uint8d_<isa>_<shift>, convert_int16_<isa>_kernel,
+ * convert_float32_<isa>_kernel, convert_packed<bits>_<isa>_kernel,
+ * convert_bfp<bits>_<isa>_kernel and per instruction set a table of the
+ * 8-bit kernels indexed by shift and one of the packed kernels indexed by
+ * format, plus the peak scan peak_<isa>_kernel and the power sum
+ * power_<isa>_kernel.
+ */
+
+#define DEFINE_UINT8_KERNEL(isa, target, shift) \
+	target static void convert_uint8_##isa##_##shift(char *out, const short *xi, const short *xq, unsigned int n) \
+	{ \
+		uint8_##isa((unsigned char *)out, xi, xq, n, shift, 0); \
+	} \
+	target static void convert_uint8d_##isa##_##shift(char *out, const short *xi, const short *xq, unsigned int n) \
+	{ \
+		uint8_##isa((unsigned char *)out, xi, xq, n, shift, 1); \
+	}
+
+#define DEFINE_PACKED_KERNEL(isa, target, bits) \
+	target static void convert_packed##bits##_##isa##_kernel(char *out, const short *xi, const short *xq, unsigned int n) \
+	{ \
+		packed_##isa((unsigned char *)out, xi, xq, n, bits); \
+	}
+
+#define DEFINE_BFP_KERNEL(isa, target, bits) \
+	target static void convert_bfp##bits##_##isa##_kernel(char *out, const short *xi, const short *xq, unsigned int n) \
+	{ \
+		bfp_##isa((unsigned char *)out, xi, xq, n, bits); \
+	}
+
+#define DEFINE_KERNELS(isa, target) \
+	DEFINE_UINT8_KERNEL(isa, target, 0) \
+	DEFINE_UINT8_KERNEL(isa, target, 1) \
+	DEFINE_UINT8_KERNEL(isa, target, 2) \
+	DEFINE_UINT8_KERNEL(isa, target, 3) \
+	DEFINE_UINT8_KERNEL(isa, target, 4) \
+	DEFINE_UINT8_KERNEL(isa, target, 5) \
+	DEFINE_UINT8_KERNEL(isa, target, 6) \
+	DEFINE_UINT8_KERNEL(isa, target, 7) \
+	DEFINE_UINT8_KERNEL(isa, target, 8) \
+	DEFINE_UINT8_KERNEL(isa, target, 9) \
+	DEFINE_UINT8_KERNEL(isa, target, 10) \
+	DEFINE_UINT8_KERNEL(isa, target, 11) \
+	DEFINE_UINT8_KERNEL(isa, target, 12) \
+	DEFINE_UINT8_KERNEL(isa, target, 13) \
+	DEFINE_UINT8_KERNEL(isa, target, 14) \
+	DEFINE_UINT8_KERNEL(isa, target, 15) \
+	DEFINE_UINT8_KERNEL(isa, target, 16) \
+	target static void convert_int16_##isa##_kernel(char *out, const short *xi, const short *xq, unsigned int n) \
+	{ \
+		int16_##isa((short *)out, xi, xq, n); \
+	} \
+	target static void convert_float32_##isa##_kernel(char *out, const short *xi, const short *xq, unsigned int n) \
+	{ \
+		float32_##isa((float *)out, xi, xq, n); \
+	} \
+	DEFINE_PACKED_KERNEL(isa, target, 10) \
+	DEFINE_PACKED_KERNEL(isa, target, 12) \
+	DEFINE_PACKED_KERNEL(isa, target, 14) \
+	DEFINE_BFP_KERNEL(isa, target, 8) \
+	DEFINE_BFP_KERNEL(isa, target, 6) \
+	static const convert_fn uint8_##isa##_kernels[CONVERT_MAX_SHIFT + 1] = { \
+		convert_uint8_##isa##_0, convert_uint8_##isa##_1, convert_uint8_##isa##_2, \
+		convert_uint8_##isa##_3, convert_uint8_##isa##_4, convert_uint8_##isa##_5, \
+		convert_uint8_##isa##_6, convert_uint8_##isa##_7, convert_uint8_##isa##_8, \
+		convert_uint8_##isa##_9, convert_uint8_##isa##_10, convert_uint8_##isa##_11, \
+		convert_uint8_##isa##_12, convert_uint8_##isa##_13, convert_uint8_##isa##_14, \
+		convert_uint8_##isa##_15, convert_uint8_##isa##_16 \
+	}; \
+	static const convert_fn uint8d_##isa##_kernels[CONVERT_MAX_SHIFT + 1] = { \
+		convert_uint8d_##isa##_0, convert_uint8d_##isa##_1, convert_uint8d_##isa##_2, \
+		convert_uint8d_##isa##_3, convert_uint8d_##isa##_4, convert_uint8d_##isa##_5, \
+		convert_uint8d_##isa##_6, convert_uint8d_##isa##_7, convert_uint8d_##isa##_8, \
+		convert_uint8d_##isa##_9, convert_uint8d_##isa##_10, convert_uint8d_##isa##_11, \
+		convert_uint8d_##isa##_12, convert_uint8d_##isa##_13, convert_uint8d_##isa##_14, \
+		convert_uint8d_##isa##_15, convert_uint8d_##isa##_16 \
+	}; \
+	static const convert_fn packed_##isa##_kernels[3] = { \
+		convert_packed10_##isa##_kernel, convert_packed12_##isa##_kernel, convert_packed14_##isa##_kernel \
+	}; \
+	static const convert_fn bfp_##isa##_kernels[2] = { \
+		convert_bfp8_##isa##_kernel, convert_bfp6_##isa##_kernel \
+	}; \
+	target static int peak_##isa##_kernel(const short *xi, const short *xq, unsigned int n) \
+	{ \
+		return peak_##isa(xi, xq, n); \
+	} \
+	target static unsigned long long power_##isa##_kernel(const short *xi, const short *xq, unsigned int n) \
+	{ \
+		return power_##isa(xi, xq, n); \
+	}
+
+#define NO_TARGET
+
+DEFINE_KERNELS(scalar, NO_TARGET)
+#ifdef CONVERT_X86
+DEFINE_KERNELS(sse2, CONVERT_TARGET("sse2"))
+DEFINE_KERNELS(avx2, CONVERT_TARGET("avx2"))
+#endif
+#ifdef CONVERT_NEON
+DEFINE_KERNELS(neon, NO_TARGET)
+#endif
+
+static const convert_fn *uint8_kernels = uint8_scalar_kernels;
+static const convert_fn *uint8d_kernels = uint8d_scalar_kernels;
+static convert_fn int16_kernel = convert_int16_scalar_kernel;
+static convert_fn float32_kernel = convert_float32_scalar_kernel;
+static const convert_fn *packed_kernels = packed_scalar_kernels;
+static const convert_fn *bfp_kernels = bfp_scalar_kernels;
+static int (*peak_kernel)(const short *xi, const short *xq, unsigned int n) = peak_scalar_kernel;
+static unsigned long long (*power_kernel)(const short *xi, const short *xq, unsigned int n) = power_scalar_kernel;
+static const char *kernel_name = "scalar";
+static convert_isa_t kernel_isa = CONVERT_ISA_SCALAR;
+
+void convert_uint8_scalar(unsigned char *out, const short *xi, const short *xq, unsigned int n, int shift, int dither)
+{
+	uint8_scalar(out, xi, xq, n, shift, dither);
+}
+
+void convert_int16_scalar(short *out, const short *xi, const short *xq, unsigned int n)
+{
+	int16_scalar(out, xi, xq, n);
+}
+
+void convert_float32_scalar(float *out, const short *xi, const short *xq, unsigned int n)
+{
+	float32_scalar(out, xi, xq, n);
+}
+
+void convert_packed_scalar(unsigned char *out, const short *xi, const short *xq, unsigned int n, int bits)
+{
+	packed_scalar(out, xi, xq, n, bits);
+}
+
+void convert_bfp_scalar(unsigned char *out, const short *xi, const short *xq, unsigned int n, int bits)
+{
+	bfp_scalar(out, xi, xq, n, bits);
+}
+
+#define USE_KERNELS(isa, id) \
+	do { \
+		uint8_kernels = uint8_##isa##_kernels; \
+		uint8d_kernels = uint8d_##isa##_kernels; \
+		int16_kernel = convert_int16_##isa##_kernel; \
+		float32_kernel = convert_float32_##isa##_kernel; \
+		packed_kernels = packed_##isa##_kernels; \
+		bfp_kernels = bfp_##isa##_kernels; \
+		peak_kernel = peak_##isa##_kernel; \
+		power_kernel = power_##isa##_kernel; \
+		kernel_name = #isa; \
+		kernel_isa = id; \
+	} while (0)
+
+int convert_use(convert_isa_t isa)
+{
+	unsigned int j;
+
+	switch (isa) {
+	case CONVERT_ISA_SCALAR:
+		USE_KERNELS(scalar, CONVERT_ISA_SCALAR);
+		break;
+#ifdef CONVERT_X86
+	case CONVERT_ISA_SSE2:
+		if (!cpu_has_sse2()) {
+			return -1;
+		}
+		USE_KERNELS(sse2, CONVERT_ISA_SSE2);
+		break;
+	case CONVERT_ISA_AVX2:
+		if (!cpu_has_avx2()) {
+			return -1;
+		}
+		USE_KERNELS(avx2, CONVERT_ISA_AVX2);
+		break;
+#endif
+#ifdef CONVERT_NEON
+	case CONVERT_ISA_NEON:
+		if (!cpu_has_neon()) {
+			return -1;
+		}
+		USE_KERNELS(neon, CONVERT_ISA_NEON);
+		break;
+#endif
+	default:
+		return -1;
+	}
+
+	// any nonzero seeds will do, the lanes only have to differ
+	for (j = 0; j < CONVERT_DITHER_LANES; j++) {
+		dither_lanes[j] = 0x9e3779b9u * (j + 1);
+	}
+
+	return 0;
+}
+
+void convert_init(void)
+{
+	if (convert_use(CONVERT_ISA_AVX2) == 0 || convert_use(CONVERT_ISA_SSE2) == 0 || convert_use(CONVERT_ISA_NEON) == 0) {
+		return;
+	}
+
+	convert_use(CONVERT_ISA_SCALAR);
+}
+
+const char *convert_name(void)
+{
+	return kernel_name;
+}
+
+convert_isa_t convert_isa(void)
+{
+	return kernel_isa;
+}
+
+int convert_peak_bits(const short *xi, const short *xq, unsigned int n)
+{
+	int peak = peak_kernel(xi, xq, n);
+	int bits = 0;
+
+	while (peak >> bits) {
+		bits++;
+	}
+
+	return bits;
+}
+
+unsigned long long convert_power(const short *xi, const short *xq, unsigned int n)
+{
+	return power_kernel(xi, xq, n);
+}
+
+int convert_packed_bits(rsp_tcp_sample_format_t format)
+{
+	switch (format) {
+	case RSP_TCP_SAMPLE_FORMAT_PACKED10:
+		return 10;
+	case RSP_TCP_SAMPLE_FORMAT_PACKED12:
+		return 12;
+	case RSP_TCP_SAMPLE_FORMAT_PACKED14:
+		return 14;
+	default:
+		return 0;
+	}
+}
+
+int convert_bfp_bits(rsp_tcp_sample_format_t format)
+{
+	switch (format) {
+	case RSP_TCP_SAMPLE_FORMAT_BFP8:
+		return 8;
+	case RSP_TCP_SAMPLE_FORMAT_BFP6:
+		return 6;
+	default:
+		return 0;
+	}
+}
+
+unsigned int convert_group_samples(rsp_tcp_sample_format_t format)
+{
+	if (convert_bfp_bits(format)) {
+		return RSP_TCP_BFP_BLOCK_SAMPLES;
+	}
+
+	return convert_packed_bits(format) ? RSP_TCP_PACKED_GROUP_SAMPLES : 1;
+}
+
+unsigned int convert_group_bytes(rsp_tcp_sample_format_t format)
+{
+	switch (format) {
+	case RSP_TCP_SAMPLE_FORMAT_FLOAT32:
+		return 2 * sizeof(float);
+	case RSP_TCP_SAMPLE_FORMAT_INT16:
+	case RSP_TCP_SAMPLE_FORMAT_RICE16:
+		// Rice blocks vary in size, count them at what they were before coding
+		return 2 * sizeof(short);
+	case RSP_TCP_SAMPLE_FORMAT_UINT8:
+		return 2;
+	case RSP_TCP_SAMPLE_FORMAT_BFP8:
+	case RSP_TCP_SAMPLE_FORMAT_BFP6:
+		return 1 + RSP_TCP_BFP_BLOCK_SAMPLES * 2 * convert_bfp_bits(format) / 8;
+	default:
+		return convert_packed_bits(format) * 4 / 8;
+	}
+}
+
+convert_fn convert_select(rsp_tcp_sample_format_t format, int shift, int dither)
+{
+	if (format == RSP_TCP_SAMPLE_FORMAT_INT16) {
+		return int16_kernel;
+	}
+	if (format == RSP_TCP_SAMPLE_FORMAT_FLOAT32) {
+		return float32_kernel;
+	}
+	if (format == RSP_TCP_SAMPLE_FORMAT_RICE16) {
+		// coded by rice_encode()
+		return NULL;
+	}
+	if (convert_packed_bits(format)) {
+		return packed_kernels[(convert_packed_bits(format) - 10) / 2];
+	}
+	if (convert_bfp_bits(format)) {
+		return bfp_kernels[format == RSP_TCP_SAMPLE_FORMAT_BFP6];
+	}
+
+	// from 16 up every sample but 0 saturates, as it does at 16
+	if (shift < 0) {
+		shift = 0;
+	}
+	else if (shift > CONVERT_MAX_SHIFT) {
+		shift = CONVERT_MAX_SHIFT;
+	}
+
+	return dither ? uint8d_kernels[shift] : uint8_kernels[shift];
+}
@@ -0,0 +1,66 @@
+#ifndef _RSP_TCP_CONVERT_H
+#define _RSP_TCP_CONVERT_H
+
+#include "rsp_tcp_api.h"
+
+/*
+ * Sample format conversion kernels.
+ *
+ * The input is the planar int16 I/Q of one SDRplay callback, the output is
+ * interleaved in the wire format. There is one kernel per (format, shift)
+ * pair, generated at compile time so the shift is an immediate, and the
+ * vector variants are picked at startup by convert_init() from what the CPU
+ * supports. Every variant produces exactly the same bytes as the scalar
+ * reference.
+ */
+
+typedef void (*convert_fn)(char *out, const short *xi, const short *xq, unsigned int n);
+
+// 8-bit shifts beyond this saturate like this one, see convert_uint8_scalar()
+#define CONVERT_MAX_SHIFT 16
+
+typedef enum {
+	CONVERT_ISA_SCALAR = 0,
+	CONVERT_ISA_SSE2 = 1,
+	CONVERT_ISA_AVX2 = 2,
+	CONVERT_ISA_NEON = 3
+} convert_isa_t;
+
+void convert_init(void);
+
+// kernels of one instruction set instead, -1 when the build or the CPU does not have it
+int convert_use(convert_isa_t isa);
+
+// name of the selected kernel set, for the startup banner
+const char *convert_name(void);
+
+// instruction set of the selected kernel set, the DSP kernels follow it
+convert_isa_t convert_isa(void);
+
+// kernel for a format, shift and 8-bit dither switch, only call again when one of them changes
+convert_fn convert_select(rsp_tcp_sample_format_t format, int shift, int dither);
+
+// bit length of the largest magnitude among n I/Q samples, 0 to 15
+int convert_peak_bits(const short *xi, const short *xq, unsigned int n);
+
+// sum of the squared I and Q values of n samples, the block power
+unsigned long long convert_power(const short *xi, const short *xq, unsigned int n);
+
+// bits per component of a packed format, 0 for the others
+int convert_packed_bits(rsp_tcp_sample_format_t format);
+
+// mantissa bits of a block floating point format, 0 for the others
+int convert_bfp_bits(rsp_tcp_sample_format_t format);
+
+// kernels are called with whole groups of samples, a group fills whole bytes
+unsigned int convert_group_samples(rsp_tcp_sample_format_t format);
+unsigned int convert_group_bytes(rsp_tcp_sample_format_t format);
+
+// reference implementations
+void convert_uint8_scalar(unsigned char *out, const short *xi, const short *xq, unsigned int n, int shift, int dither);
+void convert_int16_scalar(short *out, const short *xi, const short *xq, unsigned int n);
+void convert_float32_scalar(float *out, const short *xi, const short *xq, unsigned int n);
+void convert_packed_scalar(unsigned char *out, const short *xi, const short *xq, unsigned int n, int bits);
+void convert_bfp_scalar(unsigned char *out, const short *xi, const short *xq, unsigned int n, int bits);
+
+#endif /* _RSP_TCP_CONVERT_H */
@@ -0,0 +1,909 @@
+/*
+* rsp_tcp - signal processing stages
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <math.h>
+#include <string.h>
+
+#include "rsp_tcp_convert.h"
+#include "rsp_tcp_dsp.h"
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define DSP_X86
+#include <emmintrin.h>
+#include <immintrin.h>
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define DSP_NEON
+#include <arm_neon.h>
+#endif
+
+#ifdef _MSC_VER
+#define DSP_TARGET(t)
+#define DSP_INLINE static __forceinline
+#else
+#define DSP_TARGET(t) __attribute__((target(t)))
+#define DSP_INLINE static inline __attribute__((always_inline))
+#endif
+
+#define DSP_PI 3.14159265358979323846
+
+// Kaiser window shape of every filter, about 70 dB of stopband
+#define DSP_KAISER_BETA 7.0
+
+// the two halves of the symmetric half-band taps meet at this even sample
+#define HALFBAND_SPAN (2 * DSP_HALFBAND_K - 1)
+
+// nonzero taps of the first half of the half-band filter, all stages share them
+static float halfband_taps[DSP_HALFBAND_K];
+
+/*
+ * Kernel bodies.
+ *
+ * halfband: y[m] = o[m] / 2 + sum over k of g[k] * (e[m + k] + e[m + 2K - 1 - k])
+ * fir:      y[m] = sum over j of h[j] * x[m * factor + j], summed in eight
+ *           interleaved partial sums that are added up pairwise at the end
+ * resample: the same sum with taps interpolated linearly between two
+ *           neighbouring phases
+ * mix:      x[j] *= r[j % 8] in complex, the eight rotators turn by s after
+ *           every eight samples
+ * fold:     v[i] = sum over b of h[b * n + i] * x[b * n + i], b counting up
+ */
+
+DSP_INLINE void halfband_scalar(float *y, const float *e, const float *o, unsigned int n)
+{
+	unsigned int m, k;
+	float acc;
+
+	for (m = 0; m < n; m++)
+	{
+		acc = 0.5f * o[m];
+		for (k = 0; k < DSP_HALFBAND_K; k++) {
+			acc += halfband_taps[k] * (e[m + k] + e[m + HALFBAND_SPAN - k]);
+		}
+		y[m] = acc;
+	}
+}
+
+// ntaps is a multiple of 8
+DSP_INLINE float dot_scalar(const float *x, const float *h, unsigned int ntaps)
+{
+	float a[8] = { 0 };
+	unsigned int j, l;
+
+	for (j = 0; j < ntaps; j += 8) {
+		for (l = 0; l < 8; l++) {
+			a[l] += h[j + l] * x[j + l];
+		}
+	}
+
+	return ((a[0] + a[4]) + (a[2] + a[6])) + ((a[1] + a[5]) + (a[3] + a[7]));
+}
+
+// h = h0 + frac * (h1 - h0), n is a multiple of 8
+DSP_INLINE void lerp_scalar(float *h, const float *h0, const float *h1, float frac, unsigned int n)
+{
+	unsigned int j;
+
+	for (j = 0; j < n; j++) {
+		h[j] = h0[j] + frac * (h1[j] - h0[j]);
+	}
+}
+
+DSP_INLINE void mix_scalar(float *xi, float *xq, unsigned int n, float *ri, float *rq, float si, float sq)
+{
+	unsigned int j, l;
+	float a, b;
+
+	for (j = 0; j < n; j += 8) {
+		for (l = 0; l < 8 && j + l < n; l++) {
+			a = xi[j + l];
+			b = xq[j + l];
+			xi[j + l] = a * ri[l] - b * rq[l];
+			xq[j + l] = a * rq[l] + b * ri[l];
+		}
+		for (l = 0; l < 8; l++) {
+			a = ri[l];
+			ri[l] = a * si - rq[l] * sq;
+			rq[l] = a * sq + rq[l] * si;
+		}
+	}
+}
+
+DSP_INLINE void fold_scalar(float *v, const float *x, const float *h, unsigned int n, unsigned int taps)
+{
+	unsigned int i, j;
+	float acc;
+
+	for (i = 0; i < n; i++) {
+		acc = 0.0f;
+		for (j = i; j < taps; j += n) {
+			acc += h[j] * x[j];
+		}
+		v[i] = acc;
+	}
+}
+
+#ifdef DSP_X86
+DSP_TARGET("sse2")
+DSP_INLINE void halfband_sse2(float *y, const float *e, const float *o, unsigned int n)
+{
+	const __m128 half = _mm_set1_ps(0.5f);
+	unsigned int m, k;
+	__m128 acc, g;
+
+	for (m = 0; m + 4 <= n; m += 4)
+	{
+		acc = _mm_mul_ps(half, _mm_loadu_ps(o + m));
+		for (k = 0; k < DSP_HALFBAND_K; k++) {
+			g = _mm_set1_ps(halfband_taps[k]);
+			acc = _mm_add_ps(acc, _mm_mul_ps(g, _mm_add_ps(_mm_loadu_ps(e + m + k), _mm_loadu_ps(e + m + HALFBAND_SPAN - k))));
+		}
+		_mm_storeu_ps(y + m, acc);
+	}
+
+	halfband_scalar(y + m, e + m, o + m, n - m);
+}
+
+DSP_TARGET("sse2")
+DSP_INLINE float dot_sse2(const float *x, const float *h, unsigned int ntaps)
+{
+	__m128 lo = _mm_setzero_ps(), hi = _mm_setzero_ps(), s;
+	unsigned int j;
+
+	for (j = 0; j < ntaps; j += 8) {
+		lo = _mm_add_ps(lo, _mm_mul_ps(_mm_loadu_ps(h + j), _mm_loadu_ps(x + j)));
+		hi = _mm_add_ps(hi, _mm_mul_ps(_mm_loadu_ps(h + j + 4), _mm_loadu_ps(x + j + 4)));
+	}
+
+	s = _mm_add_ps(lo, hi);
+	s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+	return _mm_cvtss_f32(_mm_add_ss(s, _mm_shuffle_ps(s, s, 1)));
+}
+
+DSP_TARGET("sse2")
+DSP_INLINE void lerp_sse2(float *h, const float *h0, const float *h1, float frac, unsigned int n)
+{
+	const __m128 f = _mm_set1_ps(frac);
+	__m128 a;
+	unsigned int j;
+
+	for (j = 0; j < n; j += 4) {
+		a = _mm_loadu_ps(h0 + j);
+		_mm_storeu_ps(h + j, _mm_add_ps(a, _mm_mul_ps(f, _mm_sub_ps(_mm_loadu_ps(h1 + j), a))));
+	}
+}
+
+DSP_TARGET("sse2")
+DSP_INLINE void mix_sse2(float *xi, float *xq, unsigned int n, float *ri, float *rq, float si, float sq)
+{
+	const __m128 vsi = _mm_set1_ps(si), vsq = _mm_set1_ps(sq);
+	__m128 r[2][2], a, b, t;
+	unsigned int j, k;
+
+	for (k = 0; k < 2; k++) {
+		r[k][0] = _mm_loadu_ps(ri + 4 * k);
+		r[k][1] = _mm_loadu_ps(rq + 4 * k);
+	}
+
+	for (j = 0; j + 8 <= n; j += 8) {
+		for (k = 0; k < 2; k++) {
+			a = _mm_loadu_ps(xi + j + 4 * k);
+			b = _mm_loadu_ps(xq + j + 4 * k);
+			_mm_storeu_ps(xi + j + 4 * k, _mm_sub_ps(_mm_mul_ps(a, r[k][0]), _mm_mul_ps(b, r[k][1])));
+			_mm_storeu_ps(xq + j + 4 * k, _mm_add_ps(_mm_mul_ps(a, r[k][1]), _mm_mul_ps(b, r[k][0])));
+			t = r[k][0];
+			r[k][0] = _mm_sub_ps(_mm_mul_ps(t, vsi), _mm_mul_ps(r[k][1], vsq));
+			r[k][1] = _mm_add_ps(_mm_mul_ps(t, vsq), _mm_mul_ps(r[k][1], vsi));
+		}
+	}
+
+	for (k = 0; k < 2; k++) {
+		_mm_storeu_ps(ri + 4 * k, r[k][0]);
+		_mm_storeu_ps(rq + 4 * k, r[k][1]);
+	}
+	mix_scalar(xi + j, xq + j, n - j, ri, rq, si, sq);
+}
+
+DSP_TARGET("sse2")
+DSP_INLINE void fold_sse2(float *v, const float *x, const float *h, unsigned int n, unsigned int taps)
+{
+	unsigned int i, j;
+	__m128 acc;
+
+	for (i = 0; i + 4 <= n; i += 4) {
+		acc = _mm_setzero_ps();
+		for (j = i; j < taps; j += n) {
+			acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(h + j), _mm_loadu_ps(x + j)));
+		}
+		_mm_storeu_ps(v + i, acc);
+	}
+
+	fold_scalar(v + i, x + i, h + i, n - i, taps - i);
+}
+
+DSP_TARGET("avx2")
+DSP_INLINE void halfband_avx2(float *y, const float *e, const float *o, unsigned int n)
+{
+	const __m256 half = _mm256_set1_ps(0.5f);
+	unsigned int m, k;
+	__m256 acc, g;
+
+	for (m = 0; m + 8 <= n; m += 8)
+	{
+		acc = _mm256_mul_ps(half, _mm256_loadu_ps(o + m));
+		for (k = 0; k < DSP_HALFBAND_K; k++) {
+			g = _mm256_set1_ps(halfband_taps[k]);
+			acc = _mm256_add_ps(acc, _mm256_mul_ps(g, _mm256_add_ps(_mm256_loadu_ps(e + m + k), _mm256_loadu_ps(e + m + HALFBAND_SPAN - k))));
+		}
+		_mm256_storeu_ps(y + m, acc);
+	}
+
+	halfband_scalar(y + m, e + m, o + m, n - m);
+}
+
+DSP_TARGET("avx2")
+DSP_INLINE float dot_avx2(const float *x, const float *h, unsigned int ntaps)
+{
+	__m256 acc = _mm256_setzero_ps();
+	__m128 s;
+	unsigned int j;
+
+	for (j = 0; j < ntaps; j += 8) {
+		acc = _mm256_add_ps(acc, _mm256_mul_ps(_mm256_loadu_ps(h + j), _mm256_loadu_ps(x + j)));
+	}
+
+	s = _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+	s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+	return _mm_cvtss_f32(_mm_add_ss(s, _mm_shuffle_ps(s, s, 1)));
+}
+
+DSP_TARGET("avx2")
+DSP_INLINE void lerp_avx2(float *h, const float *h0, const float *h1, float frac, unsigned int n)
+{
+	const __m256 f = _mm256_set1_ps(frac);
+	__m256 a;
+	unsigned int j;
+
+	for (j = 0; j < n; j += 8) {
+		a = _mm256_loadu_ps(h0 + j);
+		_mm256_storeu_ps(h + j, _mm256_add_ps(a, _mm256_mul_ps(f, _mm256_sub_ps(_mm256_loadu_ps(h1 + j), a))));
+	}
+}
+
+DSP_TARGET("avx2")
+DSP_INLINE void mix_avx2(float *xi, float *xq, unsigned int n, float *ri, float *rq, float si, float sq)
+{
+	const __m256 vsi = _mm256_set1_ps(si), vsq = _mm256_set1_ps(sq);
+	__m256 ci = _mm256_loadu_ps(ri), cq = _mm256_loadu_ps(rq), a, b, t;
+	unsigned int j;
+
+	for (j = 0; j + 8 <= n; j += 8) {
+		a = _mm256_loadu_ps(xi + j);
+		b = _mm256_loadu_ps(xq + j);
+		_mm256_storeu_ps(xi + j, _mm256_sub_ps(_mm256_mul_ps(a, ci), _mm256_mul_ps(b, cq)));
+		_mm256_storeu_ps(xq + j, _mm256_add_ps(_mm256_mul_ps(a, cq), _mm256_mul_ps(b, ci)));
+		t = ci;
+		ci = _mm256_sub_ps(_mm256_mul_ps(t, vsi), _mm256_mul_ps(cq, vsq));
+		cq = _mm256_add_ps(_mm256_mul_ps(t, vsq), _mm256_mul_ps(cq, vsi));
+	}
+
+	_mm256_storeu_ps(ri, ci);
+	_mm256_storeu_ps(rq, cq);
+	mix_scalar(xi + j, xq + j, n - j, ri, rq, si, sq);
+}
+
+DSP_TARGET("avx2")
+DSP_INLINE void fold_avx2(float *v, const float *x, const float *h, unsigned int n, unsigned int taps)
+{
+	unsigned int i, j;
+	__m256 acc;
+
+	for (i = 0; i + 8 <= n; i += 8) {
+		acc = _mm256_setzero_ps();
+		for (j = i; j < taps; j += n) {
+			acc = _mm256_add_ps(acc, _mm256_mul_ps(_mm256_loadu_ps(h + j), _mm256_loadu_ps(x + j)));
+		}
+		_mm256_storeu_ps(v + i, acc);
+	}
+
+	fold_scalar(v + i, x + i, h + i, n - i, taps - i);
+}
+#endif
+
+#ifdef DSP_NEON
+// separate multiply and add, a fused multiply-add would round differently
+DSP_INLINE void halfband_neon(float *y, const float *e, const float *o, unsigned int n)
+{
+	const float32x4_t half = vdupq_n_f32(0.5f);
+	unsigned int m, k;
+	float32x4_t acc, g;
+
+	for (m = 0; m + 4 <= n; m += 4)
+	{
+		acc = vmulq_f32(half, vld1q_f32(o + m));
+		for (k = 0; k < DSP_HALFBAND_K; k++) {
+			g = vdupq_n_f32(halfband_taps[k]);
+			acc = vaddq_f32(acc, vmulq_f32(g, vaddq_f32(vld1q_f32(e + m + k), vld1q_f32(e + m + HALFBAND_SPAN - k))));
+		}
+		vst1q_f32(y + m, acc);
+	}
+
+	halfband_scalar(y + m, e + m, o + m, n - m);
+}
+
+DSP_INLINE float dot_neon(const float *x, const float *h, unsigned int ntaps)
+{
+	float32x4_t lo = vdupq_n_f32(0.0f), hi = vdupq_n_f32(0.0f), s;
+	float32x2_t t;
+	unsigned int j;
+
+	for (j = 0; j < ntaps; j += 8) {
+		lo = vaddq_f32(lo, vmulq_f32(vld1q_f32(h + j), vld1q_f32(x + j)));
+		hi = vaddq_f32(hi, vmulq_f32(vld1q_f32(h + j + 4), vld1q_f32(x + j + 4)));
+	}
+
+	s = vaddq_f32(lo, hi);
+	t = vadd_f32(vget_low_f32(s), vget_high_f32(s));
+	return vget_lane_f32(t, 0) + vget_lane_f32(t, 1);
+}
+
+DSP_INLINE void lerp_neon(float *h, const float *h0, const float *h1, float frac, unsigned int n)
+{
+	const float32x4_t f = vdupq_n_f32(frac);
+	float32x4_t a;
+	unsigned int j;
+
+	for (j = 0; j < n; j += 4) {
+		a = vld1q_f32(h0 + j);
+		vst1q_f32(h + j, vaddq_f32(a, vmulq_f32(f, vsubq_f32(vld1q_f32(h1 + j), a))));
+	}
+}
+
+DSP_INLINE void mix_neon(float *xi, float *xq, unsigned int n, float *ri, float *rq, float si, float sq)
+{
+	const float32x4_t vsi = vdupq_n_f32(si), vsq = vdupq_n_f32(sq);
+	float32x4_t r[2][2], a, b, t;
+	unsigned int j, k;
+
+	for (k = 0; k < 2; k++) {
+		r[k][0] = vld1q_f32(ri + 4 * k);
+		r[k][1] = vld1q_f32(rq + 4 * k);
+	}
+
+	for (j = 0; j + 8 <= n; j += 8) {
+		for (k = 0; k < 2; k++) {
+			a = vld1q_f32(xi + j + 4 * k);
+			b = vld1q_f32(xq + j + 4 * k);
+			vst1q_f32(xi + j + 4 * k, vsubq_f32(vmulq_f32(a, r[k][0]), vmulq_f32(b, r[k][1])));
+			vst1q_f32(xq + j + 4 * k, vaddq_f32(vmulq_f32(a, r[k][1]), vmulq_f32(b, r[k][0])));
+			t = r[k][0];
+			r[k][0] = vsubq_f32(vmulq_f32(t, vsi), vmulq_f32(r[k][1], vsq));
+			r[k][1] = vaddq_f32(vmulq_f32(t, vsq), vmulq_f32(r[k][1], vsi));
+		}
+	}
+
+	for (k = 0; k < 2; k++) {
+		vst1q_f32(ri + 4 * k, r[k][0]);
+		vst1q_f32(rq + 4 * k, r[k][1]);
+	}
+	mix_scalar(xi + j, xq + j, n - j, ri, rq, si, sq);
+}
+
+DSP_INLINE void fold_neon(float *v, const float *x, const float *h, unsigned int n, unsigned int taps)
+{
+	unsigned int i, j;
+	float32x4_t acc;
+
+	for (i = 0; i + 4 <= n; i += 4) {
+		acc = vdupq_n_f32(0.0f);
+		for (j = i; j < taps; j += n) {
+			acc = vaddq_f32(acc, vmulq_f32(vld1q_f32(h + j), vld1q_f32(x + j)));
+		}
+		vst1q_f32(v + i, acc);
+	}
+
+	fold_scalar(v + i, x + i, h + i, n - i, taps - i);
+}
+#endif
+
+/*
+ * Generated kernels: halfband_<isa>_kernel, fir_<isa>_kernel computing n
+ * outputs of a decimation by factor, and resample_<isa>_kernel computing one
+ * I/Q output with the taps frac of the way from phase h0 to phase h1,
+ * mix_<isa>_kernel turning n samples by the rotators r and their step s, and
+ * fold_<isa>_kernel summing taps samples into n branches.
+ */
+#define DEFINE_DSP_KERNELS(isa, target) \
+	target static void halfband_##isa##_kernel(float *y, const float *e, const float *o, unsigned int n) \
+	{ \
+		halfband_##isa(y, e, o, n); \
+	} \
+	target static void fir_##isa##_kernel(float *y, const float *x, const float *h, unsigned int ntaps, unsigned int factor, unsigned int n) \
+	{ \
+		unsigned int m; \
+		for (m = 0; m < n; m++) { \
+			y[m] = dot_##isa(x + m * factor, h, ntaps); \
+		} \
+	} \
+	target static void resample_##isa##_kernel(float *yi, float *yq, const float *xi, const float *xq, const float *h0, const float *h1, float frac) \
+	{ \
+		float h[DSP_RESAMPLER_TAPS]; \
+		lerp_##isa(h, h0, h1, frac, DSP_RESAMPLER_TAPS); \
+		*yi = dot_##isa(xi, h, DSP_RESAMPLER_TAPS); \
+		*yq = dot_##isa(xq, h, DSP_RESAMPLER_TAPS); \
+	} \
+	target static void mix_##isa##_kernel(float *xi, float *xq, unsigned int n, float *ri, float *rq, float si, float sq) \
+	{ \
+		mix_##isa(xi, xq, n, ri, rq, si, sq); \
+	} \
+	target static void fold_##isa##_kernel(float *v, const float *x, const float *h, unsigned int n, unsigned int taps) \
+	{ \
+		fold_##isa(v, x, h, n, taps); \
+	}
+
+#define NO_TARGET
+
+DEFINE_DSP_KERNELS(scalar, NO_TARGET)
+#ifdef DSP_X86
+DEFINE_DSP_KERNELS(sse2, DSP_TARGET("sse2"))
+DEFINE_DSP_KERNELS(avx2, DSP_TARGET("avx2"))
+#endif
+#ifdef DSP_NEON
+DEFINE_DSP_KERNELS(neon, NO_TARGET)
+#endif
+
+static void (*halfband_kernel)(float *y, const float *e, const float *o, unsigned int n) = halfband_scalar_kernel;
+static void (*fir_kernel)(float *y, const float *x, const float *h, unsigned int ntaps, unsigned int factor, unsigned int n) = fir_scalar_kernel;
+static void (*resample_kernel)(float *yi, float *yq, const float *xi, const float *xq, const float *h0, const float *h1, float frac) = resample_scalar_kernel;
+static void (*mix_kernel)(float *xi, float *xq, unsigned int n, float *ri, float *rq, float si, float sq) = mix_scalar_kernel;
+static void (*fold_kernel)(float *v, const float *x, const float *h, unsigned int n, unsigned int taps) = fold_scalar_kernel;
+
+static double bessel_i0(double x)
+{
+	double sum = 1.0, term = 1.0;
+	int k;
+
+	for (k = 1; k < 50; k++) {
+		term *= (x / (2.0 * k)) * (x / (2.0 * k));
+		sum += term;
+	}
+
+	return sum;
+}
+
+// Kaiser windowed sinc low pass, cutoff relative to the sample rate
+static void kaiser_lowpass(double *h, unsigned int n, double cutoff)
+{
+	double t, r;
+	unsigned int i;
+
+	for (i = 0; i < n; i++) {
+		t = i - (n - 1) / 2.0;
+		r = 2.0 * t / (n - 1);
+		h[i] = t == 0.0 ? 2.0 * cutoff : sin(2.0 * DSP_PI * cutoff * t) / (DSP_PI * t);
+		h[i] *= bessel_i0(DSP_KAISER_BETA * sqrt(1.0 - r * r)) / bessel_i0(DSP_KAISER_BETA);
+	}
+}
+
+void dsp_init(void)
+{
+	double h[4 * DSP_HALFBAND_K - 1];
+	double sum = 0.0;
+	unsigned int k;
+
+	// the odd taps around the centre are zero, the even ones carry half the gain
+	kaiser_lowpass(h, 4 * DSP_HALFBAND_K - 1, 0.25);
+	for (k = 0; k < DSP_HALFBAND_K; k++) {
+		sum += h[2 * k];
+	}
+	for (k = 0; k < DSP_HALFBAND_K; k++) {
+		halfband_taps[k] = (float)(h[2 * k] * 0.25 / sum);
+	}
+
+	halfband_kernel = halfband_scalar_kernel;
+	fir_kernel = fir_scalar_kernel;
+	resample_kernel = resample_scalar_kernel;
+	mix_kernel = mix_scalar_kernel;
+	fold_kernel = fold_scalar_kernel;
+
+	switch (convert_isa()) {
+#ifdef DSP_X86
+	case CONVERT_ISA_AVX2:
+		halfband_kernel = halfband_avx2_kernel;
+		fir_kernel = fir_avx2_kernel;
+		resample_kernel = resample_avx2_kernel;
+		mix_kernel = mix_avx2_kernel;
+		fold_kernel = fold_avx2_kernel;
+		break;
+	case CONVERT_ISA_SSE2:
+		halfband_kernel = halfband_sse2_kernel;
+		fir_kernel = fir_sse2_kernel;
+		resample_kernel = resample_sse2_kernel;
+		mix_kernel = mix_sse2_kernel;
+		fold_kernel = fold_sse2_kernel;
+		break;
+#endif
+#ifdef DSP_NEON
+	case CONVERT_ISA_NEON:
+		halfband_kernel = halfband_neon_kernel;
+		fir_kernel = fir_neon_kernel;
+		resample_kernel = resample_neon_kernel;
+		mix_kernel = mix_neon_kernel;
+		fold_kernel = fold_neon_kernel;
+		break;
+#endif
+	default:
+		break;
+	}
+}
+
+// prototype at DSP_RESAMPLER_PHASES times the input rate, cut off at the output Nyquist rate
+static void resampler_init(dsp_resampler_t *r, unsigned int in_rate, unsigned int out_rate)
+{
+	static double h[DSP_RESAMPLER_PHASES * DSP_RESAMPLER_TAPS + 1];
+	double sum = 0.0;
+	unsigned int i, p, n = DSP_RESAMPLER_PHASES * DSP_RESAMPLER_TAPS;
+
+	kaiser_lowpass(h, n, 0.5 * out_rate / in_rate / DSP_RESAMPLER_PHASES);
+	h[n] = 0.0;
+	for (i = 0; i < n; i++) {
+		sum += h[i];
+	}
+
+	// every phase on its own has unity gain
+	for (p = 0; p <= DSP_RESAMPLER_PHASES; p++) {
+		for (i = 0; i < DSP_RESAMPLER_TAPS; i++) {
+			r->taps[p][i] = (float)(h[(DSP_RESAMPLER_TAPS - 1 - i) * DSP_RESAMPLER_PHASES + p] * DSP_RESAMPLER_PHASES / sum);
+		}
+	}
+
+	r->in_rate = in_rate;
+	r->out_rate = out_rate;
+	r->step = in_rate / out_rate;
+	r->step_rem = in_rate % out_rate;
+	memset(r->x, 0, sizeof(r->x));
+	r->nx = DSP_RESAMPLER_TAPS - 1;
+	r->next = DSP_RESAMPLER_TAPS - 1;
+	r->rem = 0;
+}
+
+int dsp_decimator_init(dsp_decimator_t *d, unsigned int factor, unsigned int in_rate, unsigned int out_rate)
+{
+	double h[DSP_MAX_FIR_TAPS];
+	double sum = 0.0;
+	unsigned int i, halfbands = 0;
+
+	if (factor == 0 || (out_rate != in_rate && (out_rate >= in_rate || out_rate <= in_rate / 2))) {
+		return -1;
+	}
+	for (i = factor; i % 2 == 0; i /= 2) {
+		halfbands++;
+	}
+	if (halfbands > DSP_MAX_HALFBANDS || i > DSP_MAX_FIR_DECIMATION) {
+		return -1;
+	}
+
+	d->nco_phase = 0;
+	d->nco_step = 0;
+	d->factor = factor;
+	d->halfbands = halfbands;
+	factor = i;
+
+	// both filters start from silence
+	memset(d->hb, 0, sizeof(d->hb));
+	for (i = 0; i < d->halfbands; i++) {
+		d->hb[i].ne = HALFBAND_SPAN;
+		d->hb[i].no = DSP_HALFBAND_K;
+	}
+
+	memset(&d->fir, 0, sizeof(d->fir));
+	d->fir.factor = factor;
+	if (factor > 1) {
+		d->fir.ntaps = DSP_FIR_TAPS_PER_PHASE * factor;
+		kaiser_lowpass(h, d->fir.ntaps, 0.5 / factor);
+		for (i = 0; i < d->fir.ntaps; i++) {
+			sum += h[i];
+		}
+		// symmetric, so the taps need no reversing
+		for (i = 0; i < d->fir.ntaps; i++) {
+			d->fir.taps[i] = (float)(h[i] / sum);
+		}
+		d->fir.nx = d->fir.ntaps - 1;
+	}
+
+	d->resampling = out_rate != in_rate;
+	if (d->resampling) {
+		resampler_init(&d->rs, in_rate, out_rate);
+	}
+
+	return 0;
+}
+
+int dsp_decimator_active(const dsp_decimator_t *d)
+{
+	return d->nco_step != 0 || d->factor > 1 || d->resampling;
+}
+
+// decimation the down-converter uses, 0 when out_rate is out of its reach
+static unsigned int ddc_factor(unsigned int in_rate, unsigned int out_rate)
+{
+	unsigned int factor, odd;
+
+	if (out_rate == 0 || out_rate > in_rate) {
+		return 0;
+	}
+
+	// an exact ratio needs no resampler
+	if (in_rate % out_rate == 0) {
+		factor = in_rate / out_rate;
+		for (odd = factor; odd % 2 == 0; odd /= 2);
+		if (odd <= DSP_MAX_FIR_DECIMATION && factor / odd <= (1u << DSP_MAX_HALFBANDS)) {
+			return factor;
+		}
+	}
+
+	// otherwise half-bands down to less than twice out_rate
+	for (factor = 1; factor < (1u << DSP_MAX_HALFBANDS) && in_rate / (2.0 * factor) >= out_rate; factor *= 2);
+	return in_rate / (2.0 * factor) >= out_rate ? 0 : factor;
+}
+
+int dsp_ddc_supported(unsigned int in_rate, int offset, unsigned int out_rate)
+{
+	return ddc_factor(in_rate, out_rate) != 0 && (offset < 0 ? -(double)offset : offset) <= in_rate / 2.0;
+}
+
+int dsp_ddc_init(dsp_decimator_t *d, unsigned int in_rate, int offset, unsigned int out_rate)
+{
+	unsigned int factor = ddc_factor(in_rate, out_rate);
+
+	if (!dsp_ddc_supported(in_rate, offset, out_rate)) {
+		return -1;
+	}
+
+	// the resampler only sees the ratio of the rates, and none at all for an exact factor
+	dsp_decimator_init(d, factor, in_rate, out_rate * factor);
+
+	dsp_ddc_set_offset(d, in_rate, offset);
+	return 0;
+}
+
+void dsp_ddc_set_offset(dsp_decimator_t *d, unsigned int in_rate, int offset)
+{
+	// the cast to unsigned wraps a negative step around the circle
+	d->nco_step = (unsigned int)(long long)floor(-(double)offset / in_rate * 4294967296.0 + 0.5);
+}
+
+static unsigned int halfband_run(dsp_halfband_t *hb, float in[2][DSP_CHUNK], unsigned int n, float out[2][DSP_CHUNK])
+{
+	unsigned int i, c, nout;
+
+	// the next sample is even when both phases have as many new samples
+	for (i = 0; i < n; i++) {
+		if (hb->ne - HALFBAND_SPAN == hb->no - DSP_HALFBAND_K) {
+			hb->e[0][hb->ne] = in[0][i];
+			hb->e[1][hb->ne++] = in[1][i];
+		}
+		else {
+			hb->o[0][hb->no] = in[0][i];
+			hb->o[1][hb->no++] = in[1][i];
+		}
+	}
+
+	// one output per complete pair, then keep what the next outputs still need
+	nout = hb->no - DSP_HALFBAND_K;
+	for (c = 0; c < 2; c++) {
+		halfband_kernel(out[c], hb->e[c], hb->o[c], nout);
+		memmove(hb->e[c], hb->e[c] + nout, (hb->ne - nout) * sizeof(float));
+		memmove(hb->o[c], hb->o[c] + nout, (hb->no - nout) * sizeof(float));
+	}
+	hb->ne -= nout;
+	hb->no -= nout;
+
+	return nout;
+}
+
+static unsigned int fir_run(dsp_fir_decimator_t *f, float in[2][DSP_CHUNK], unsigned int n, float out[2][DSP_CHUNK])
+{
+	unsigned int c, nout, used;
+
+	for (c = 0; c < 2; c++) {
+		memcpy(f->x[c] + f->nx, in[c], n * sizeof(float));
+	}
+	f->nx += n;
+
+	nout = f->nx < f->ntaps ? 0 : (f->nx - f->ntaps) / f->factor + 1;
+	used = nout * f->factor;
+	for (c = 0; c < 2; c++) {
+		fir_kernel(out[c], f->x[c], f->taps, f->ntaps, f->factor, nout);
+		memmove(f->x[c], f->x[c] + used, (f->nx - used) * sizeof(float));
+	}
+	f->nx -= used;
+
+	return nout;
+}
+
+static unsigned int resample_run(dsp_resampler_t *r, float in[2][DSP_CHUNK], unsigned int n, float out[2][DSP_CHUNK])
+{
+	unsigned int c, p, nout = 0, drop;
+	double phase, to_phase = (double)DSP_RESAMPLER_PHASES / r->out_rate;
+
+	for (c = 0; c < 2; c++) {
+		memcpy(r->x[c] + r->nx, in[c], n * sizeof(float));
+	}
+	r->nx += n;
+
+	// the output between input next and the one after needs the taps up to next
+	while (r->next < r->nx) {
+		phase = r->rem * to_phase;
+		p = (unsigned int)phase;
+		resample_kernel(&out[0][nout], &out[1][nout],
+			r->x[0] + r->next - (DSP_RESAMPLER_TAPS - 1), r->x[1] + r->next - (DSP_RESAMPLER_TAPS - 1),
+			r->taps[p], r->taps[p + 1], (float)(phase - p));
+		nout++;
+
+		r->next += r->step;
+		r->rem += r->step_rem;
+		if (r->rem >= r->out_rate) {
+			r->rem -= r->out_rate;
+			r->next++;
+		}
+	}
+
+	drop = r->next - (DSP_RESAMPLER_TAPS - 1);
+	for (c = 0; c < 2; c++) {
+		memmove(r->x[c], r->x[c] + drop, (r->nx - drop) * sizeof(float));
+	}
+	r->nx -= drop;
+	r->next -= drop;
+
+	return nout;
+}
+
+// the rotators start from the exact phase in every chunk, so rounding never piles up
+static void mix_run(dsp_decimator_t *d, float x[2][DSP_CHUNK], unsigned int n)
+{
+	const double to_radians = 2.0 * DSP_PI / 4294967296.0;
+	float ri[8], rq[8];
+	unsigned int l;
+
+	for (l = 0; l < 8; l++) {
+		ri[l] = (float)cos((d->nco_phase + l * d->nco_step) * to_radians);
+		rq[l] = (float)sin((d->nco_phase + l * d->nco_step) * to_radians);
+	}
+
+	mix_kernel(x[0], x[1], n, ri, rq, (float)cos(8 * d->nco_step * to_radians), (float)sin(8 * d->nco_step * to_radians));
+	d->nco_phase += n * d->nco_step;
+}
+
+// rounded half away from zero and saturated
+static short to_short(float x)
+{
+	x += x < 0.0f ? -0.5f : 0.5f;
+	return x >= 32767.0f ? 32767 : x <= -32768.0f ? -32768 : (short)x;
+}
+
+unsigned int dsp_decimate(dsp_decimator_t *d, const short *xi, const short *xq, unsigned int n, short *yi, short *yq)
+{
+	// the stages only ever run on the conversion thread
+	static float work[2][2][DSP_CHUNK];
+	unsigned int i, s, c, cur, count, total = 0;
+
+	while (n > 0) {
+		c = n < DSP_CHUNK ? n : DSP_CHUNK;
+		for (i = 0; i < c; i++) {
+			work[0][0][i] = xi[i];
+			work[0][1][i] = xq[i];
+		}
+
+		if (d->nco_step) {
+			mix_run(d, work[0], c);
+		}
+
+		// each stage reads one work buffer and writes the other
+		count = c;
+		cur = 0;
+		for (s = 0; s < d->halfbands; s++, cur ^= 1) {
+			count = halfband_run(&d->hb[s], work[cur], count, work[cur ^ 1]);
+		}
+		if (d->fir.factor > 1) {
+			count = fir_run(&d->fir, work[cur], count, work[cur ^ 1]);
+			cur ^= 1;
+		}
+		if (d->resampling) {
+			count = resample_run(&d->rs, work[cur], count, work[cur ^ 1]);
+			cur ^= 1;
+		}
+
+		for (i = 0; i < count; i++) {
+			yi[total + i] = to_short(work[cur][0][i]);
+			yq[total + i] = to_short(work[cur][1][i]);
+		}
+
+		total += count;
+		xi += c;
+		xq += c;
+		n -= c;
+	}
+
+	return total;
+}
+
+int dsp_channelizer_init(dsp_channelizer_t *c, unsigned int channels, unsigned int step)
+{
+	static double h[DSP_MAX_CHANNELS * DSP_CHANNEL_TAPS];
+	double sum = 0.0;
+	unsigned int i, taps = channels * DSP_CHANNEL_TAPS;
+
+	if (channels > DSP_MAX_CHANNELS || (step != channels && step != channels / 2)) {
+		return -1;
+	}
+	fft_free(&c->fft);
+	if (fft_init(&c->fft, channels)) {
+		return -1;
+	}
+
+	c->channels = channels;
+	c->step = step;
+
+	// cut off at the channel edge, or past it where the wider output leaves room
+	kaiser_lowpass(h, taps, (step == channels ? 0.5 : 0.75) / channels);
+	for (i = 0; i < taps; i++) {
+		sum += h[i];
+	}
+	// symmetric like the FIR, so the branches need no reversing either
+	for (i = 0; i < taps; i++) {
+		c->h[i] = (float)(h[i] / sum);
+	}
+
+	return 0;
+}
+
+void dsp_channelizer_free(dsp_channelizer_t *c)
+{
+	fft_free(&c->fft);
+	c->channels = 0;
+}
+
+/*
+ * The branch sums of the window ending at input t, transformed, give
+ * channel k turned by e^(2 pi j k (t + 1) / channels); the twiddles of the
+ * FFT turn it back.
+ */
+void dsp_channelize(const dsp_channelizer_t *c, const float *xi, const float *xq, unsigned int rows, unsigned int phase,
+	const unsigned int *bins, unsigned int nbins, short *yi, short *yq)
+{
+	float v[2][DSP_MAX_CHANNELS];
+	float work[2 * DSP_MAX_CHANNELS];
+	const float *twr = c->fft.tw, *twi = c->fft.tw + c->channels;
+	unsigned int r, j, k, t, mask = c->channels - 1, taps = c->channels * DSP_CHANNEL_TAPS;
+
+	for (r = 0; r < rows; r++) {
+		fold_kernel(v[0], xi + r * c->step, c->h, c->channels, taps);
+		fold_kernel(v[1], xq + r * c->step, c->h, c->channels, taps);
+		fft_forward(&c->fft, v[0], v[1], work);
+
+		t = (phase + r * c->step) & mask;
+		for (j = 0; j < nbins; j++) {
+			k = bins[j];
+			yi[j] = to_short(v[0][k] * twr[(k * t) & mask] - v[1][k] * twi[(k * t) & mask]);
+			yq[j] = to_short(v[0][k] * twi[(k * t) & mask] + v[1][k] * twr[(k * t) & mask]);
+		}
+		yi += nbins;
+		yq += nbins;
+	}
+}
@@ -0,0 +1,155 @@
+#ifndef _RSP_TCP_DSP_H
+#define _RSP_TCP_DSP_H
+
+#include "rsp_tcp_fft.h"
+
+/*
+ * Signal processing stages of the conversion thread.
+ *
+ * They sit between the raw callback blocks and the sample format converters
+ * and take and give planar int16 I/Q, so every sample format works on their
+ * output. The work is done in float. The kernels come in the instruction set
+ * variants of the format converters and follow the choice of convert_init();
+ * the vector variants evaluate the same expressions in the same order as the
+ * scalar reference.
+ */
+
+// input samples per call of a stage, longer runs are split by dsp_decimate()
+#define DSP_CHUNK 1024
+
+// half-band stages have 4 * DSP_HALFBAND_K - 1 taps, half of them zero
+#define DSP_HALFBAND_K 12
+#define DSP_MAX_HALFBANDS 14
+
+// the final decimation by an odd factor runs a 24 * factor tap FIR
+#define DSP_FIR_TAPS_PER_PHASE 24
+#define DSP_MAX_FIR_DECIMATION 31
+#define DSP_MAX_FIR_TAPS (DSP_FIR_TAPS_PER_PHASE * DSP_MAX_FIR_DECIMATION)
+
+// largest decimation dsp_decimator_init() accepts
+#define DSP_MAX_DECIMATION ((1 << DSP_MAX_HALFBANDS) * DSP_MAX_FIR_DECIMATION)
+
+// the channelizer prototype spans this many outputs of every channel
+#define DSP_MAX_CHANNELS 1024
+#define DSP_CHANNEL_TAPS 16
+
+// the fractional resampler interpolates between the nearest two of its phases
+#define DSP_RESAMPLER_PHASES 128
+#define DSP_RESAMPLER_TAPS 48
+
+/*
+ * Decimation by two. The input is kept split into its even and odd samples,
+ * each after the history the filter still needs: the even samples meet the
+ * symmetric taps, the odd ones only the centre tap.
+ */
+typedef struct {
+	float e[2][2 * DSP_HALFBAND_K - 1 + DSP_CHUNK / 2 + 1];
+	float o[2][DSP_HALFBAND_K + DSP_CHUNK / 2];
+	unsigned int ne, no;
+} dsp_halfband_t;
+
+/*
+ * Polyphase FIR decimator, only the samples that are kept get computed.
+ * x holds the history followed by the new input of each component.
+ */
+typedef struct {
+	float taps[DSP_MAX_FIR_TAPS];
+	unsigned int ntaps;
+	unsigned int factor;
+	float x[2][DSP_MAX_FIR_TAPS + DSP_CHUNK];
+	unsigned int nx;
+} dsp_fir_decimator_t;
+
+/*
+ * Polyphase resampler by out_rate / in_rate, at most 1. The output times
+ * are kept as an input sample index and a remainder in units of 1 / out_rate,
+ * so exactly out_rate samples come out for every in_rate that go in. Row p
+ * of taps is the phase p / DSP_RESAMPLER_PHASES of the way to the next input
+ * sample, reversed to match x; the last row repeats the first one shifted.
+ */
+typedef struct {
+	float taps[DSP_RESAMPLER_PHASES + 1][DSP_RESAMPLER_TAPS];
+	unsigned int in_rate, out_rate;
+	unsigned int step, step_rem;
+	unsigned int next, rem;
+	float x[2][DSP_RESAMPLER_TAPS + DSP_CHUNK];
+	unsigned int nx;
+} dsp_resampler_t;
+
+/*
+ * The optional mixer in front, then half-band stages for the power of two
+ * part of the factor, the FIR and the resampler. The mixer turns the input
+ * by nco_phase, a fraction of a full turn in units of 2^-32, which advances
+ * by nco_step every sample.
+ */
+typedef struct {
+	unsigned int nco_phase, nco_step;
+	unsigned int factor;
+	unsigned int halfbands;
+	int resampling;
+	dsp_halfband_t hb[DSP_MAX_HALFBANDS];
+	dsp_fir_decimator_t fir;
+	dsp_resampler_t rs;
+} dsp_decimator_t;
+
+// after convert_init()
+void dsp_init(void);
+
+/*
+ * Clears the filter state, returns -1 for a chain that cannot be done. The
+ * resampler runs when out_rate differs from in_rate, and needs
+ * in_rate / 2 < out_rate < in_rate. With a factor of 1 and no resampling
+ * there is nothing to do and dsp_decimate() must not be called.
+ */
+int dsp_decimator_init(dsp_decimator_t *d, unsigned int factor, unsigned int in_rate, unsigned int out_rate);
+
+// 0 when dsp_decimator_init() found nothing to do
+int dsp_decimator_active(const dsp_decimator_t *d);
+
+/*
+ * Down-converter: the signal offset Hz from the centre of the input is
+ * moved to 0 Hz and decimated to out_rate, of which the centre 80 % are
+ * passband. Integer ratios the decimator can do take the half-bands and the
+ * FIR, other ratios half-bands and the resampler. dsp_ddc_init() returns -1
+ * where dsp_ddc_supported() returns 0.
+ */
+int dsp_ddc_supported(unsigned int in_rate, int offset, unsigned int out_rate);
+int dsp_ddc_init(dsp_decimator_t *d, unsigned int in_rate, int offset, unsigned int out_rate);
+
+// moves the mixer to a new offset without touching the filters
+void dsp_ddc_set_offset(dsp_decimator_t *d, unsigned int in_rate, int offset);
+
+/*
+ * Polyphase filter bank. Channel k of the power of two channels is the
+ * input turned down by k / channels of its rate and low pass filtered, with
+ * an output every step input samples: step is channels, or channels / 2 for
+ * outputs at twice the channel spacing that keep the channel edges clear of
+ * aliases. Each output folds channels * DSP_CHANNEL_TAPS input samples,
+ * weighted by the prototype filter, into channels branch sums, and one FFT
+ * of those gives every channel at once.
+ */
+typedef struct {
+	unsigned int channels;
+	unsigned int step;
+	float h[DSP_MAX_CHANNELS * DSP_CHANNEL_TAPS];
+	fft_t fft;
+} dsp_channelizer_t;
+
+// returns -1 for a channel count or step it cannot do
+int dsp_channelizer_init(dsp_channelizer_t *c, unsigned int channels, unsigned int step);
+void dsp_channelizer_free(dsp_channelizer_t *c);
+
+/*
+ * rows outputs of the channels listed in bins, each row the nbins samples
+ * of one output time. Row r is computed from x[r * step] on; phase is one
+ * more than the index of the last input sample of row 0, counted from the
+ * first input sample since dsp_channelizer_init(), modulo channels. Only
+ * reads c, so threads can compute different rows at the same time.
+ */
+void dsp_channelize(const dsp_channelizer_t *c, const float *xi, const float *xq, unsigned int rows, unsigned int phase,
+	const unsigned int *bins, unsigned int nbins, short *yi, short *yq);
+
+// returns the number of output samples, at most n / factor + 1
+unsigned int dsp_decimate(dsp_decimator_t *d, const short *xi, const short *xq, unsigned int n, short *yi, short *yq);
+
+#endif /* _RSP_TCP_DSP_H */
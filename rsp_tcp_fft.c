@@ -0,0 +1,508 @@
+/*
+* rsp_tcp - FFT
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rsp_tcp_convert.h"
+#include "rsp_tcp_fft.h"
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define FFT_X86
+#include <emmintrin.h>
+#include <immintrin.h>
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define FFT_NEON
+#include <arm_neon.h>
+#endif
+
+#ifdef _MSC_VER
+#define FFT_TARGET(t)
+#define FFT_INLINE static __forceinline
+#else
+#define FFT_TARGET(t) __attribute__((target(t)))
+#define FFT_INLINE static inline __attribute__((always_inline))
+#endif
+
+#define FFT_PI 3.14159265358979323846
+
+int fft_init(fft_t *f, unsigned int n)
+{
+	unsigned int k, m, p, s;
+	float *w;
+
+	if (n < FFT_MIN_SIZE || n > FFT_MAX_SIZE || (n & (n - 1)) != 0) {
+		return -1;
+	}
+
+	// the stage twiddles take 6 (n / 4 + n / 16 + ...) floats, less than 2 * n
+	f->tw = (float *)malloc(4 * n * sizeof(float));
+	if (f->tw == NULL) {
+		return -1;
+	}
+
+	f->n = n;
+	for (k = 0; k < n; k++) {
+		f->tw[k] = (float)cos(2.0 * FFT_PI * k / n);
+		f->tw[n + k] = (float)-sin(2.0 * FFT_PI * k / n);
+	}
+
+	f->stage_tw = f->tw + 2 * n;
+	for (w = f->stage_tw, m = n / 4, s = 1; m >= 1; m /= 4, s *= 4) {
+		for (p = 0; p < m; p++) {
+			for (k = 1; k <= 3; k++) {
+				w[(2 * k - 2) * m + p] = f->tw[k * p * s];
+				w[(2 * k - 1) * m + p] = f->tw[n + k * p * s];
+			}
+		}
+		w += 6 * m;
+	}
+
+	return 0;
+}
+
+void fft_free(fft_t *f)
+{
+	free(f->tw);
+	f->tw = NULL;
+	f->stage_tw = NULL;
+	f->n = 0;
+}
+
+/*
+ * Kernel bodies.
+ *
+ * radix4: one stage over sub-transforms of 4 * m points that lie s apart,
+ *         the four quarters of each are combined with a 4-point DFT and
+ *         turned by the twiddles w of their output index, which the next
+ *         stage sees 4 * s apart
+ * radix2: the last stage of an odd power of two, 2-point DFTs need no
+ *         twiddles
+ *
+ * The vector variants run four or eight values of q side by side, or of p
+ * in the first stage where s is 1, and evaluate the same expressions in the
+ * same order as the scalar code, so every variant gives the same result.
+ */
+static void radix4_scalar(unsigned int m, unsigned int s, const float *w, const float *xr, const float *xi, float *yr, float *yi)
+{
+	unsigned int p, q, a, y;
+	float w1r, w1i, w2r, w2i, w3r, w3i;
+	float apcr, apci, amcr, amci, bpdr, bpdi, bmdr, bmdi, tr, ti;
+
+	for (p = 0; p < m; p++) {
+		w1r = w[p];
+		w1i = w[m + p];
+		w2r = w[2 * m + p];
+		w2i = w[3 * m + p];
+		w3r = w[4 * m + p];
+		w3i = w[5 * m + p];
+
+		for (q = 0; q < s; q++) {
+			a = q + s * p;
+			y = q + s * 4 * p;
+
+			apcr = xr[a] + xr[a + 2 * m * s];
+			apci = xi[a] + xi[a + 2 * m * s];
+			amcr = xr[a] - xr[a + 2 * m * s];
+			amci = xi[a] - xi[a + 2 * m * s];
+			bpdr = xr[a + m * s] + xr[a + 3 * m * s];
+			bpdi = xi[a + m * s] + xi[a + 3 * m * s];
+			bmdr = xr[a + m * s] - xr[a + 3 * m * s];
+			bmdi = xi[a + m * s] - xi[a + 3 * m * s];
+
+			yr[y] = apcr + bpdr;
+			yi[y] = apci + bpdi;
+
+			// (a - c) - j (b - d)
+			tr = amcr + bmdi;
+			ti = amci - bmdr;
+			yr[y + s] = tr * w1r - ti * w1i;
+			yi[y + s] = tr * w1i + ti * w1r;
+
+			tr = apcr - bpdr;
+			ti = apci - bpdi;
+			yr[y + 2 * s] = tr * w2r - ti * w2i;
+			yi[y + 2 * s] = tr * w2i + ti * w2r;
+
+			// (a - c) + j (b - d)
+			tr = amcr - bmdi;
+			ti = amci + bmdr;
+			yr[y + 3 * s] = tr * w3r - ti * w3i;
+			yi[y + 3 * s] = tr * w3i + ti * w3r;
+		}
+	}
+}
+
+static void radix2_scalar(unsigned int s, const float *xr, const float *xi, float *yr, float *yi)
+{
+	unsigned int q;
+
+	for (q = 0; q < s; q++) {
+		yr[q] = xr[q] + xr[q + s];
+		yi[q] = xi[q] + xi[q + s];
+		yr[q + s] = xr[q] - xr[q + s];
+		yi[q + s] = xi[q] - xi[q + s];
+	}
+}
+
+#ifdef FFT_X86
+// r and i hold a, b, c and d on the way in and the four outputs on the way out, w the six twiddle parts
+FFT_TARGET("sse2")
+FFT_INLINE void butterfly_sse2(__m128 *r, __m128 *i, const __m128 *w)
+{
+	__m128 apcr = _mm_add_ps(r[0], r[2]), apci = _mm_add_ps(i[0], i[2]);
+	__m128 amcr = _mm_sub_ps(r[0], r[2]), amci = _mm_sub_ps(i[0], i[2]);
+	__m128 bpdr = _mm_add_ps(r[1], r[3]), bpdi = _mm_add_ps(i[1], i[3]);
+	__m128 bmdr = _mm_sub_ps(r[1], r[3]), bmdi = _mm_sub_ps(i[1], i[3]);
+	__m128 tr, ti;
+
+	r[0] = _mm_add_ps(apcr, bpdr);
+	i[0] = _mm_add_ps(apci, bpdi);
+
+	tr = _mm_add_ps(amcr, bmdi);
+	ti = _mm_sub_ps(amci, bmdr);
+	r[1] = _mm_sub_ps(_mm_mul_ps(tr, w[0]), _mm_mul_ps(ti, w[1]));
+	i[1] = _mm_add_ps(_mm_mul_ps(tr, w[1]), _mm_mul_ps(ti, w[0]));
+
+	tr = _mm_sub_ps(apcr, bpdr);
+	ti = _mm_sub_ps(apci, bpdi);
+	r[2] = _mm_sub_ps(_mm_mul_ps(tr, w[2]), _mm_mul_ps(ti, w[3]));
+	i[2] = _mm_add_ps(_mm_mul_ps(tr, w[3]), _mm_mul_ps(ti, w[2]));
+
+	tr = _mm_sub_ps(amcr, bmdi);
+	ti = _mm_add_ps(amci, bmdr);
+	r[3] = _mm_sub_ps(_mm_mul_ps(tr, w[4]), _mm_mul_ps(ti, w[5]));
+	i[3] = _mm_add_ps(_mm_mul_ps(tr, w[5]), _mm_mul_ps(ti, w[4]));
+}
+
+FFT_TARGET("sse2")
+static void radix4_sse2(unsigned int m, unsigned int s, const float *w, const float *xr, const float *xi, float *yr, float *yi)
+{
+	__m128 r[4], i[4], wv[6];
+	unsigned int p, q, k, a, y;
+
+	if (s >= 4) {
+		for (p = 0; p < m; p++) {
+			for (k = 0; k < 6; k++) {
+				wv[k] = _mm_set1_ps(w[k * m + p]);
+			}
+			for (q = 0; q < s; q += 4) {
+				a = q + s * p;
+				y = q + s * 4 * p;
+				for (k = 0; k < 4; k++) {
+					r[k] = _mm_loadu_ps(xr + a + k * m * s);
+					i[k] = _mm_loadu_ps(xi + a + k * m * s);
+				}
+				butterfly_sse2(r, i, wv);
+				for (k = 0; k < 4; k++) {
+					_mm_storeu_ps(yr + y + k * s, r[k]);
+					_mm_storeu_ps(yi + y + k * s, i[k]);
+				}
+			}
+		}
+	}
+	else if (m >= 4) {
+		// first stage, four values of p go to four consecutive outputs each
+		for (p = 0; p < m; p += 4) {
+			for (k = 0; k < 6; k++) {
+				wv[k] = _mm_loadu_ps(w + k * m + p);
+			}
+			for (k = 0; k < 4; k++) {
+				r[k] = _mm_loadu_ps(xr + p + k * m);
+				i[k] = _mm_loadu_ps(xi + p + k * m);
+			}
+			butterfly_sse2(r, i, wv);
+			_MM_TRANSPOSE4_PS(r[0], r[1], r[2], r[3]);
+			_MM_TRANSPOSE4_PS(i[0], i[1], i[2], i[3]);
+			for (k = 0; k < 4; k++) {
+				_mm_storeu_ps(yr + 4 * p + 4 * k, r[k]);
+				_mm_storeu_ps(yi + 4 * p + 4 * k, i[k]);
+			}
+		}
+	}
+	else {
+		radix4_scalar(m, s, w, xr, xi, yr, yi);
+	}
+}
+
+FFT_TARGET("sse2")
+static void radix2_sse2(unsigned int s, const float *xr, const float *xi, float *yr, float *yi)
+{
+	__m128 ar, ai, br, bi;
+	unsigned int q;
+
+	if (s < 4) {
+		radix2_scalar(s, xr, xi, yr, yi);
+		return;
+	}
+
+	for (q = 0; q < s; q += 4) {
+		ar = _mm_loadu_ps(xr + q);
+		ai = _mm_loadu_ps(xi + q);
+		br = _mm_loadu_ps(xr + q + s);
+		bi = _mm_loadu_ps(xi + q + s);
+		_mm_storeu_ps(yr + q, _mm_add_ps(ar, br));
+		_mm_storeu_ps(yi + q, _mm_add_ps(ai, bi));
+		_mm_storeu_ps(yr + q + s, _mm_sub_ps(ar, br));
+		_mm_storeu_ps(yi + q + s, _mm_sub_ps(ai, bi));
+	}
+}
+
+FFT_TARGET("avx2")
+FFT_INLINE void butterfly_avx2(__m256 *r, __m256 *i, const __m256 *w)
+{
+	__m256 apcr = _mm256_add_ps(r[0], r[2]), apci = _mm256_add_ps(i[0], i[2]);
+	__m256 amcr = _mm256_sub_ps(r[0], r[2]), amci = _mm256_sub_ps(i[0], i[2]);
+	__m256 bpdr = _mm256_add_ps(r[1], r[3]), bpdi = _mm256_add_ps(i[1], i[3]);
+	__m256 bmdr = _mm256_sub_ps(r[1], r[3]), bmdi = _mm256_sub_ps(i[1], i[3]);
+	__m256 tr, ti;
+
+	r[0] = _mm256_add_ps(apcr, bpdr);
+	i[0] = _mm256_add_ps(apci, bpdi);
+
+	tr = _mm256_add_ps(amcr, bmdi);
+	ti = _mm256_sub_ps(amci, bmdr);
+	r[1] = _mm256_sub_ps(_mm256_mul_ps(tr, w[0]), _mm256_mul_ps(ti, w[1]));
+	i[1] = _mm256_add_ps(_mm256_mul_ps(tr, w[1]), _mm256_mul_ps(ti, w[0]));
+
+	tr = _mm256_sub_ps(apcr, bpdr);
+	ti = _mm256_sub_ps(apci, bpdi);
+	r[2] = _mm256_sub_ps(_mm256_mul_ps(tr, w[2]), _mm256_mul_ps(ti, w[3]));
+	i[2] = _mm256_add_ps(_mm256_mul_ps(tr, w[3]), _mm256_mul_ps(ti, w[2]));
+
+	tr = _mm256_sub_ps(amcr, bmdi);
+	ti = _mm256_add_ps(amci, bmdr);
+	r[3] = _mm256_sub_ps(_mm256_mul_ps(tr, w[4]), _mm256_mul_ps(ti, w[5]));
+	i[3] = _mm256_add_ps(_mm256_mul_ps(tr, w[5]), _mm256_mul_ps(ti, w[4]));
+}
+
+// stages with s below 8 are left to the SSE2 kernel
+FFT_TARGET("avx2")
+static void radix4_avx2(unsigned int m, unsigned int s, const float *w, const float *xr, const float *xi, float *yr, float *yi)
+{
+	__m256 r[4], i[4], wv[6];
+	unsigned int p, q, k, a, y;
+
+	if (s < 8) {
+		radix4_sse2(m, s, w, xr, xi, yr, yi);
+		return;
+	}
+
+	for (p = 0; p < m; p++) {
+		for (k = 0; k < 6; k++) {
+			wv[k] = _mm256_set1_ps(w[k * m + p]);
+		}
+		for (q = 0; q < s; q += 8) {
+			a = q + s * p;
+			y = q + s * 4 * p;
+			for (k = 0; k < 4; k++) {
+				r[k] = _mm256_loadu_ps(xr + a + k * m * s);
+				i[k] = _mm256_loadu_ps(xi + a + k * m * s);
+			}
+			butterfly_avx2(r, i, wv);
+			for (k = 0; k < 4; k++) {
+				_mm256_storeu_ps(yr + y + k * s, r[k]);
+				_mm256_storeu_ps(yi + y + k * s, i[k]);
+			}
+		}
+	}
+}
+
+FFT_TARGET("avx2")
+static void radix2_avx2(unsigned int s, const float *xr, const float *xi, float *yr, float *yi)
+{
+	__m256 ar, ai, br, bi;
+	unsigned int q;
+
+	if (s < 8) {
+		radix2_sse2(s, xr, xi, yr, yi);
+		return;
+	}
+
+	for (q = 0; q < s; q += 8) {
+		ar = _mm256_loadu_ps(xr + q);
+		ai = _mm256_loadu_ps(xi + q);
+		br = _mm256_loadu_ps(xr + q + s);
+		bi = _mm256_loadu_ps(xi + q + s);
+		_mm256_storeu_ps(yr + q, _mm256_add_ps(ar, br));
+		_mm256_storeu_ps(yi + q, _mm256_add_ps(ai, bi));
+		_mm256_storeu_ps(yr + q + s, _mm256_sub_ps(ar, br));
+		_mm256_storeu_ps(yi + q + s, _mm256_sub_ps(ai, bi));
+	}
+}
+#endif
+
+#ifdef FFT_NEON
+FFT_INLINE void butterfly_neon(float32x4_t *r, float32x4_t *i, const float32x4_t *w)
+{
+	float32x4_t apcr = vaddq_f32(r[0], r[2]), apci = vaddq_f32(i[0], i[2]);
+	float32x4_t amcr = vsubq_f32(r[0], r[2]), amci = vsubq_f32(i[0], i[2]);
+	float32x4_t bpdr = vaddq_f32(r[1], r[3]), bpdi = vaddq_f32(i[1], i[3]);
+	float32x4_t bmdr = vsubq_f32(r[1], r[3]), bmdi = vsubq_f32(i[1], i[3]);
+	float32x4_t tr, ti;
+
+	r[0] = vaddq_f32(apcr, bpdr);
+	i[0] = vaddq_f32(apci, bpdi);
+
+	// multiplies and adds kept apart, a fused multiply-add would round differently
+	tr = vaddq_f32(amcr, bmdi);
+	ti = vsubq_f32(amci, bmdr);
+	r[1] = vsubq_f32(vmulq_f32(tr, w[0]), vmulq_f32(ti, w[1]));
+	i[1] = vaddq_f32(vmulq_f32(tr, w[1]), vmulq_f32(ti, w[0]));
+
+	tr = vsubq_f32(apcr, bpdr);
+	ti = vsubq_f32(apci, bpdi);
+	r[2] = vsubq_f32(vmulq_f32(tr, w[2]), vmulq_f32(ti, w[3]));
+	i[2] = vaddq_f32(vmulq_f32(tr, w[3]), vmulq_f32(ti, w[2]));
+
+	tr = vsubq_f32(amcr, bmdi);
+	ti = vaddq_f32(amci, bmdr);
+	r[3] = vsubq_f32(vmulq_f32(tr, w[4]), vmulq_f32(ti, w[5]));
+	i[3] = vaddq_f32(vmulq_f32(tr, w[5]), vmulq_f32(ti, w[4]));
+}
+
+static void radix4_neon(unsigned int m, unsigned int s, const float *w, const float *xr, const float *xi, float *yr, float *yi)
+{
+	float32x4_t r[4], i[4], wv[6];
+	float32x4x4_t out;
+	unsigned int p, q, k, a, y;
+
+	if (s >= 4) {
+		for (p = 0; p < m; p++) {
+			for (k = 0; k < 6; k++) {
+				wv[k] = vdupq_n_f32(w[k * m + p]);
+			}
+			for (q = 0; q < s; q += 4) {
+				a = q + s * p;
+				y = q + s * 4 * p;
+				for (k = 0; k < 4; k++) {
+					r[k] = vld1q_f32(xr + a + k * m * s);
+					i[k] = vld1q_f32(xi + a + k * m * s);
+				}
+				butterfly_neon(r, i, wv);
+				for (k = 0; k < 4; k++) {
+					vst1q_f32(yr + y + k * s, r[k]);
+					vst1q_f32(yi + y + k * s, i[k]);
+				}
+			}
+		}
+	}
+	else if (m >= 4) {
+		// first stage, four values of p go to four consecutive outputs each
+		for (p = 0; p < m; p += 4) {
+			for (k = 0; k < 6; k++) {
+				wv[k] = vld1q_f32(w + k * m + p);
+			}
+			for (k = 0; k < 4; k++) {
+				r[k] = vld1q_f32(xr + p + k * m);
+				i[k] = vld1q_f32(xi + p + k * m);
+			}
+			butterfly_neon(r, i, wv);
+			for (k = 0; k < 4; k++) {
+				out.val[k] = r[k];
+			}
+			vst4q_f32(yr + 4 * p, out);
+			for (k = 0; k < 4; k++) {
+				out.val[k] = i[k];
+			}
+			vst4q_f32(yi + 4 * p, out);
+		}
+	}
+	else {
+		radix4_scalar(m, s, w, xr, xi, yr, yi);
+	}
+}
+
+static void radix2_neon(unsigned int s, const float *xr, const float *xi, float *yr, float *yi)
+{
+	float32x4_t ar, ai, br, bi;
+	unsigned int q;
+
+	if (s < 4) {
+		radix2_scalar(s, xr, xi, yr, yi);
+		return;
+	}
+
+	for (q = 0; q < s; q += 4) {
+		ar = vld1q_f32(xr + q);
+		ai = vld1q_f32(xi + q);
+		br = vld1q_f32(xr + q + s);
+		bi = vld1q_f32(xi + q + s);
+		vst1q_f32(yr + q, vaddq_f32(ar, br));
+		vst1q_f32(yi + q, vaddq_f32(ai, bi));
+		vst1q_f32(yr + q + s, vsubq_f32(ar, br));
+		vst1q_f32(yi + q + s, vsubq_f32(ai, bi));
+	}
+}
+#endif
+
+static void (*radix4_kernel)(unsigned int m, unsigned int s, const float *w, const float *xr, const float *xi, float *yr, float *yi) = radix4_scalar;
+static void (*radix2_kernel)(unsigned int s, const float *xr, const float *xi, float *yr, float *yi) = radix2_scalar;
+
+void fft_setup(void)
+{
+	radix4_kernel = radix4_scalar;
+	radix2_kernel = radix2_scalar;
+
+	switch (convert_isa()) {
+#ifdef FFT_X86
+	case CONVERT_ISA_AVX2:
+		radix4_kernel = radix4_avx2;
+		radix2_kernel = radix2_avx2;
+		break;
+	case CONVERT_ISA_SSE2:
+		radix4_kernel = radix4_sse2;
+		radix2_kernel = radix2_sse2;
+		break;
+#endif
+#ifdef FFT_NEON
+	case CONVERT_ISA_NEON:
+		radix4_kernel = radix4_neon;
+		radix2_kernel = radix2_neon;
+		break;
+#endif
+	default:
+		break;
+	}
+}
+
+void fft_forward(const fft_t *f, float *re, float *im, float *work)
+{
+	float *xr = re, *xi = im, *yr = work, *yi = work + f->n, *t;
+	const float *w = f->stage_tw;
+	unsigned int n, s = 1;
+
+	for (n = f->n; n >= 4; n /= 4, s *= 4) {
+		radix4_kernel(n / 4, s, w, xr, xi, yr, yi);
+		w += 6 * (n / 4);
+		t = xr; xr = yr; yr = t;
+		t = xi; xi = yi; yi = t;
+	}
+	if (n == 2) {
+		radix2_kernel(s, xr, xi, yr, yi);
+		xr = yr;
+		xi = yi;
+	}
+
+	if (xr != re) {
+		memcpy(re, xr, f->n * sizeof(float));
+		memcpy(im, xi, f->n * sizeof(float));
+	}
+}
@@ -0,0 +1,39 @@
+#ifndef _RSP_TCP_FFT_H
+#define _RSP_TCP_FFT_H
+
+/*
+ * Complex FFT on planar float data.
+ *
+ * Stockham autosort: radix-4 stages while four or more points are left and
+ * a radix-2 stage for an odd power of two, each stage reading one buffer and
+ * writing the other, so the result comes out in natural order without a bit
+ * reversal pass. A plan only holds the twiddles and is never written by
+ * fft_forward(), so threads can share it. The stages run on vector kernels
+ * picked by fft_setup(), which give the same result as the scalar ones.
+ */
+
+#define FFT_MIN_SIZE 2
+#define FFT_MAX_SIZE 65536
+
+typedef struct {
+	unsigned int n;
+
+	// e^(-2 pi j k / n) for k < n, real then imaginary parts
+	float *tw;
+
+	// per radix-4 stage of n / 4 ^ (i + 1) groups: the real and imaginary parts of tw[p s],
+	// tw[2 p s] and tw[3 p s] for each group p, in the same buffer as tw
+	float *stage_tw;
+} fft_t;
+
+// picks the kernels for the CPU, after convert_init()
+void fft_setup(void);
+
+// n a power of two from FFT_MIN_SIZE to FFT_MAX_SIZE, returns -1 otherwise
+int fft_init(fft_t *f, unsigned int n);
+void fft_free(fft_t *f);
+
+// X[k] = sum over m of x[m] * e^(-2 pi j k m / n), in place; work holds 2 * n floats
+void fft_forward(const fft_t *f, float *re, float *im, float *work);
+
+#endif /* _RSP_TCP_FFT_H */
@@ -0,0 +1,303 @@
+/*
+* rsp_tcp - lock-free sample block queue
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <stdint.h>
+#include <unistd.h>
+#endif
+
+#include "rsp_tcp_queue.h"
+
+int sample_queue_init(sample_queue_t *q, unsigned int limit)
+{
+	unsigned int size = 1;
+
+	if (limit == 0 || limit > SAMPLE_QUEUE_MAX_BLOCKS) {
+		limit = SAMPLE_QUEUE_MAX_BLOCKS;
+	}
+
+	while (size < limit) {
+		size <<= 1;
+	}
+
+	memset(q, 0, sizeof(*q));
+	q->slots = (struct sample_block **)calloc(size, sizeof(struct sample_block *));
+	if (q->slots == NULL) {
+		return -1;
+	}
+
+	q->mask = size - 1;
+	q->limit = limit;
+	q->event_fd = -1;
+
+	pthread_mutex_init(&q->lock, NULL);
+	pthread_cond_init(&q->cond, NULL);
+	pthread_cond_init(&q->room_cond, NULL);
+
+	return 0;
+}
+
+void sample_queue_destroy(sample_queue_t *q)
+{
+	pthread_mutex_destroy(&q->lock);
+	pthread_cond_destroy(&q->cond);
+	pthread_cond_destroy(&q->room_cond);
+	free(q->slots);
+	q->slots = NULL;
+}
+
+int sample_queue_has_room(sample_queue_t *q, size_t len)
+{
+	size_t max_bytes = q->max_bytes;
+
+	if (sample_queue_count(q) >= q->limit) {
+		return 0;
+	}
+
+	// always let a single block through, whatever its size
+	return max_bytes == 0 || sample_queue_bytes(q) == 0 || sample_queue_bytes(q) + len <= max_bytes;
+}
+
+int sample_queue_push(sample_queue_t *q, struct sample_block *blk)
+{
+	unsigned int head = q->head;
+
+	if (head - ATOMIC_LOAD(&q->tail) > q->mask) {
+		return -1;
+	}
+
+	q->slots[head & q->mask] = blk;
+	q->bytes_in += blk->len;
+	ATOMIC_STORE(&q->head, head + 1);
+
+	return 0;
+}
+
+struct sample_block *sample_queue_steal(sample_queue_t *q)
+{
+	// same as a pop, the compare-and-swap on tail decides who owns the block
+	return sample_queue_pop(q);
+}
+
+int sample_queue_wait_room(sample_queue_t *q, size_t len, const struct timespec *deadline)
+{
+	int r = 0;
+
+	if (sample_queue_has_room(q, len)) {
+		return 0;
+	}
+
+	pthread_mutex_lock(&q->lock);
+	q->producer_waiting = 1;
+	ATOMIC_FENCE();
+	while (!sample_queue_has_room(q, len) && r != ETIMEDOUT) {
+		r = pthread_cond_timedwait(&q->room_cond, &q->lock, deadline);
+	}
+	q->producer_waiting = 0;
+	pthread_mutex_unlock(&q->lock);
+
+	return sample_queue_has_room(q, len) ? 0 : ETIMEDOUT;
+}
+
+void sample_queue_count_drop(sample_queue_t *q, struct sample_block *blk)
+{
+	sample_queue_count_lost(q, 1, blk->samples);
+}
+
+void sample_queue_count_lost(sample_queue_t *q, unsigned int blocks, unsigned int samples)
+{
+	q->dropped_blocks += blocks;
+	q->dropped_samples += samples;
+}
+
+void sample_queue_notify(sample_queue_t *q)
+{
+	// pairs with the fence in sample_queue_wait(): either the consumer
+	// sees the new head, or we see it waiting and wake it up
+	ATOMIC_FENCE();
+	if (q->waiting) {
+#ifndef _WIN32
+		if (q->event_fd >= 0) {
+			uint64_t one = 1;
+
+			if (write(q->event_fd, &one, sizeof(one)) < 0) {
+				// counter already pending, the consumer wakes up anyway
+			}
+			return;
+		}
+#endif
+		pthread_mutex_lock(&q->lock);
+		pthread_cond_signal(&q->cond);
+		pthread_mutex_unlock(&q->lock);
+	}
+}
+
+struct sample_block *sample_queue_pop(sample_queue_t *q)
+{
+	while (1) {
+		unsigned int tail = ATOMIC_LOAD(&q->tail);
+		struct sample_block *blk;
+
+		if (tail == ATOMIC_LOAD(&q->head)) {
+			return NULL;
+		}
+
+		blk = q->slots[tail & q->mask];
+		if (ATOMIC_CAS(&q->tail, tail, tail + 1)) {
+			ATOMIC_ADD(&q->bytes_out, blk->len);
+
+			// wake a producer blocked on a full queue
+			ATOMIC_FENCE();
+			if (q->producer_waiting) {
+				pthread_mutex_lock(&q->lock);
+				pthread_cond_signal(&q->room_cond);
+				pthread_mutex_unlock(&q->lock);
+			}
+			return blk;
+		}
+	}
+}
+
+int sample_queue_wait(sample_queue_t *q, const struct timespec *deadline)
+{
+	int r = 0;
+
+	if (sample_queue_count(q)) {
+		return 0;
+	}
+
+	pthread_mutex_lock(&q->lock);
+	q->waiting = 1;
+	ATOMIC_FENCE();
+	while (sample_queue_count(q) == 0 && r != ETIMEDOUT) {
+		r = pthread_cond_timedwait(&q->cond, &q->lock, deadline);
+	}
+	q->waiting = 0;
+	pthread_mutex_unlock(&q->lock);
+
+	return sample_queue_count(q) ? 0 : ETIMEDOUT;
+}
+
+void sample_queue_set_event(sample_queue_t *q, int fd)
+{
+	q->event_fd = fd;
+}
+
+unsigned int sample_queue_arm(sample_queue_t *q)
+{
+	unsigned int count;
+
+	// same handshake as sample_queue_wait(), without the mutex
+	q->waiting = 1;
+	ATOMIC_FENCE();
+	count = sample_queue_count(q);
+	if (count) {
+		q->waiting = 0;
+	}
+
+	return count;
+}
+
+void sample_queue_disarm(sample_queue_t *q)
+{
+	q->waiting = 0;
+}
+
+unsigned int sample_queue_count(sample_queue_t *q)
+{
+	unsigned int tail = ATOMIC_LOAD(&q->tail);
+
+	return ATOMIC_LOAD(&q->head) - tail;
+}
+
+size_t sample_queue_bytes(sample_queue_t *q)
+{
+	size_t out = ATOMIC_LOAD(&q->bytes_out);
+
+	return ATOMIC_LOAD(&q->bytes_in) - out;
+}
+
+void sample_queue_set_max_bytes(sample_queue_t *q, size_t max_bytes)
+{
+	q->max_bytes = max_bytes;
+}
+
+int sample_pool_init(sample_pool_t *pool, unsigned int count, size_t block_size)
+{
+	unsigned int i;
+
+	if (count == 0 || count > SAMPLE_QUEUE_MAX_BLOCKS) {
+		count = SAMPLE_QUEUE_MAX_BLOCKS;
+	}
+
+	memset(pool, 0, sizeof(*pool));
+	if (sample_queue_init(&pool->free, count) != 0) {
+		return -1;
+	}
+
+	pool->blocks = (struct sample_block *)calloc(count, sizeof(struct sample_block));
+	pool->slab = (char *)malloc(count * block_size);
+	if (pool->blocks == NULL || pool->slab == NULL) {
+		sample_pool_destroy(pool);
+		return -1;
+	}
+
+	pool->count = count;
+	pool->block_size = block_size;
+
+	for (i = 0; i < count; i++) {
+		pool->blocks[i].data = pool->slab + i * block_size;
+		pool->blocks[i].size = block_size;
+		sample_queue_push(&pool->free, &pool->blocks[i]);
+	}
+
+	return 0;
+}
+
+void sample_pool_destroy(sample_pool_t *pool)
+{
+	sample_queue_destroy(&pool->free);
+	free(pool->blocks);
+	free(pool->slab);
+	pool->blocks = NULL;
+	pool->slab = NULL;
+}
+
+struct sample_block *sample_pool_get(sample_pool_t *pool)
+{
+	struct sample_block *blk = sample_queue_pop(&pool->free);
+
+	if (blk == NULL) {
+		pool->dry++;
+		return NULL;
+	}
+
+	blk->len = 0;
+	return blk;
+}
+
+void sample_pool_put(sample_pool_t *pool, struct sample_block *blk)
+{
+	// the free list holds every block, so this never drops one
+	sample_queue_push(&pool->free, blk);
+}
@@ -0,0 +1,169 @@
+#ifndef _RSP_TCP_QUEUE_H
+#define _RSP_TCP_QUEUE_H
+
+#include <stddef.h>
+
+#define HAVE_STRUCT_TIMESPEC
+#include <pthread.h>
+
+/*
+ * Acquire / release access to the words shared between threads. Whatever a
+ * thread writes before ATOMIC_STORE() is seen by the thread whose
+ * ATOMIC_LOAD() or ATOMIC_SWAP() gets the stored value. The MSVC variants
+ * need windows.h.
+ */
+#ifdef _MSC_VER
+#define ATOMIC_LOAD(p)		(*(p))
+#define ATOMIC_STORE(p, v)	(*(p) = (v))
+#define ATOMIC_SWAP(p, v)	InterlockedExchange((volatile LONG *)(p), (LONG)(v))
+#define ATOMIC_CAS(p, o, n)	(InterlockedCompareExchange((volatile LONG *)(p), (LONG)(n), (LONG)(o)) == (LONG)(o))
+#ifdef _WIN64
+#define ATOMIC_ADD(p, v)	InterlockedExchangeAdd64((volatile LONG64 *)(p), (LONG64)(v))
+#else
+#define ATOMIC_ADD(p, v)	InterlockedExchangeAdd((volatile LONG *)(p), (LONG)(v))
+#endif
+#define ATOMIC_FENCE()		MemoryBarrier()
+#else
+#define ATOMIC_LOAD(p)		__atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define ATOMIC_STORE(p, v)	__atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define ATOMIC_SWAP(p, v)	__atomic_exchange_n((p), (v), __ATOMIC_ACQ_REL)
+#define ATOMIC_CAS(p, o, n)	__atomic_compare_exchange_n((p), &(o), (n), 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)
+#define ATOMIC_ADD(p, v)	__atomic_fetch_add((p), (v), __ATOMIC_RELEASE)
+#define ATOMIC_FENCE()		__atomic_thread_fence(__ATOMIC_SEQ_CST)
+#endif
+
+// upper bound on the number of blocks a sample queue can hold
+#define SAMPLE_QUEUE_MAX_BLOCKS (16384)
+
+// keep the producer and consumer indices on separate cache lines
+#define SAMPLE_QUEUE_CACHE_LINE (64)
+
+struct sample_block {
+	char *data;
+	size_t len;
+	size_t size;
+
+	// number of IQ samples carried by the block
+	unsigned int samples;
+
+	// sample format of the payload, a rsp_tcp_sample_format_t
+	unsigned int format;
+
+	// 8-bit sample shift of the payload
+	int shift;
+
+	// sample rate of the payload in Hz
+	unsigned int rate;
+
+	// channels interleaved in the payload
+	unsigned int channels;
+
+	// FFT size of the spectrum frame the block holds instead of samples, 0 for samples
+	unsigned int spectrum;
+
+	// only used by the producer to keep blocks it took back
+	struct sample_block *next;
+};
+
+// what the producer does with a block that does not fit in the queue
+typedef enum {
+	SAMPLE_QUEUE_DROP_OLDEST = 0,
+	SAMPLE_QUEUE_DROP_NEWEST = 1,
+	SAMPLE_QUEUE_BLOCK = 2
+} sample_queue_policy_t;
+
+/*
+ * Single producer / single consumer ring of sample blocks.
+ *
+ * The producer (the SDRplay stream callback) owns head, the consumer owns
+ * tail. When the queue is over its limits the producer can take the
+ * oldest block back by advancing tail itself, so tail is only ever moved
+ * with compare-and-swap and whoever wins the swap owns the block in that
+ * slot. Neither side takes a lock to enqueue or dequeue; the mutex and
+ * condition variable are only used to park the consumer while the queue
+ * is empty.
+ *
+ * The queue is bounded both in blocks (limit) and in payload bytes
+ * (max_bytes, 0 for no byte limit).
+ */
+typedef struct {
+	struct sample_block **slots;
+	unsigned int mask;
+	unsigned int limit;
+	volatile size_t max_bytes;
+
+	char __pad0[SAMPLE_QUEUE_CACHE_LINE];
+	volatile unsigned int head;
+	volatile size_t bytes_in;
+	char __pad1[SAMPLE_QUEUE_CACHE_LINE];
+	volatile unsigned int tail;
+	volatile size_t bytes_out;
+	char __pad2[SAMPLE_QUEUE_CACHE_LINE];
+
+	volatile int waiting;
+	volatile int producer_waiting;
+
+	// when set, a parked consumer is woken through this eventfd instead of cond
+	int event_fd;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	pthread_cond_t room_cond;
+
+	// overflow accounting, only written by the producer; 32 bits so a reader
+	// never sees half an update, they wrap and are read as differences
+	volatile unsigned int dropped_blocks;
+	volatile unsigned int dropped_samples;
+} sample_queue_t;
+
+/*
+ * Fixed set of preallocated blocks carved out of a single slab. Free
+ * blocks travel back from the consumer to the producer through a second
+ * sample queue, so neither side allocates on the data path.
+ */
+typedef struct {
+	struct sample_block *blocks;
+	char *slab;
+	unsigned int count;
+	size_t block_size;
+	sample_queue_t free;
+
+	// number of times the producer found no free block
+	volatile unsigned int dry;
+} sample_pool_t;
+
+int sample_queue_init(sample_queue_t *q, unsigned int limit);
+void sample_queue_destroy(sample_queue_t *q);
+
+// producer side
+int sample_queue_has_room(sample_queue_t *q, size_t len);
+int sample_queue_push(sample_queue_t *q, struct sample_block *blk);
+struct sample_block *sample_queue_steal(sample_queue_t *q);
+int sample_queue_wait_room(sample_queue_t *q, size_t len, const struct timespec *deadline);
+void sample_queue_notify(sample_queue_t *q);
+void sample_queue_count_drop(sample_queue_t *q, struct sample_block *blk);
+void sample_queue_count_lost(sample_queue_t *q, unsigned int blocks, unsigned int samples);
+
+// consumer side
+struct sample_block *sample_queue_pop(sample_queue_t *q);
+int sample_queue_wait(sample_queue_t *q, const struct timespec *deadline);
+
+// for consumers sleeping on event_fd in their own poll loop: arm returns the
+// number of queued blocks, when that is 0 the queue stays armed until disarm
+void sample_queue_set_event(sample_queue_t *q, int fd);
+unsigned int sample_queue_arm(sample_queue_t *q);
+void sample_queue_disarm(sample_queue_t *q);
+
+unsigned int sample_queue_count(sample_queue_t *q);
+size_t sample_queue_bytes(sample_queue_t *q);
+void sample_queue_set_max_bytes(sample_queue_t *q, size_t max_bytes);
+
+int sample_pool_init(sample_pool_t *pool, unsigned int count, size_t block_size);
+void sample_pool_destroy(sample_pool_t *pool);
+
+// called by the queue producer
+struct sample_block *sample_pool_get(sample_pool_t *pool);
+
+// called by the queue consumer
+void sample_pool_put(sample_pool_t *pool, struct sample_block *blk);
+
+#endif /* _RSP_TCP_QUEUE_H */
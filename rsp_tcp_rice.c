@@ -0,0 +1,164 @@
+/*
+* rsp_tcp - lossless Rice coding of the INT16 stream
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <windows.h>
+#else
+#include <arpa/inet.h>
+#include <time.h>
+#endif
+
+#include "rsp_tcp_rice.h"
+
+typedef struct {
+	unsigned char *out;
+	unsigned long long acc;
+	unsigned int fill;
+} bit_writer_t;
+
+static unsigned long long now_ns(void)
+{
+#ifdef _WIN32
+	LARGE_INTEGER count, freq;
+
+	QueryPerformanceCounter(&count);
+	QueryPerformanceFrequency(&freq);
+	return (unsigned long long)((double)count.QuadPart * 1e9 / freq.QuadPart);
+#else
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+// nbits is at most 32, whole 32-bit words go out as soon as they are full
+static void put_bits(bit_writer_t *w, unsigned int value, unsigned int nbits)
+{
+	w->acc |= (unsigned long long)value << w->fill;
+	w->fill += nbits;
+	if (w->fill >= 32) {
+		w->out[0] = (unsigned char)w->acc;
+		w->out[1] = (unsigned char)(w->acc >> 8);
+		w->out[2] = (unsigned char)(w->acc >> 16);
+		w->out[3] = (unsigned char)(w->acc >> 24);
+		w->out += 4;
+		w->acc >>= 32;
+		w->fill -= 32;
+	}
+}
+
+static void flush_bits(bit_writer_t *w)
+{
+	while (w->fill > 0) {
+		*(w->out++) = (unsigned char)w->acc;
+		w->acc >>= 8;
+		w->fill = w->fill > 8 ? w->fill - 8 : 0;
+	}
+	w->acc = 0;
+}
+
+static unsigned int zigzag(int e)
+{
+	return ((unsigned int)e << 1) ^ (unsigned int)(e >> 31);
+}
+
+// picks the predictor order and the Rice parameter for one component
+static void choose_coding(const short *x, unsigned int n, unsigned char *order, unsigned char *k)
+{
+	unsigned long long sum[3] = { 0, 0, 0 };
+	unsigned long long best;
+	int x1 = 0, x2 = 0;
+	unsigned int i;
+
+	for (i = 0; i < n; i++) {
+		sum[0] += zigzag(x[i]);
+		sum[1] += zigzag(x[i] - x1);
+		sum[2] += zigzag(x[i] - 2 * x1 + x2);
+		x2 = x1;
+		x1 = x[i];
+	}
+
+	*order = 0;
+	if (sum[1] < sum[*order]) {
+		*order = 1;
+	}
+	if (sum[2] < sum[*order]) {
+		*order = 2;
+	}
+	best = sum[*order];
+
+	// k = floor(log2(mean residual))
+	for (*k = 0; *k < RSP_TCP_RICE_MAX_K && ((unsigned long long)n << (*k + 1)) <= best; (*k)++);
+}
+
+static unsigned int encode_component(bit_writer_t *w, const short *x, unsigned int n, int order, unsigned int k)
+{
+	unsigned int escapes = 0;
+	unsigned int i, u, q;
+	int x1 = 0, x2 = 0, p;
+
+	for (i = 0; i < n; i++) {
+		p = order == 2 ? 2 * x1 - x2 : order == 1 ? x1 : 0;
+		u = zigzag(x[i] - p);
+		q = u >> k;
+
+		if (q < RSP_TCP_RICE_ESCAPE) {
+			// q ones, a zero, then the low k bits, at most 31 bits in one go
+			put_bits(w, ((1u << q) - 1) | (u & ((1u << k) - 1)) << (q + 1), q + 1 + k);
+		}
+		else {
+			put_bits(w, (1u << RSP_TCP_RICE_ESCAPE) - 1, RSP_TCP_RICE_ESCAPE);
+			put_bits(w, (unsigned short)x[i], 16);
+			escapes++;
+		}
+
+		x2 = x1;
+		x1 = x[i];
+	}
+
+	return escapes;
+}
+
+size_t rice_encode(char *out, const short *xi, const short *xq, unsigned int n, rice_stats_t *stats)
+{
+	rsp_tcp_rice_header_t *h = (rsp_tcp_rice_header_t *)out;
+	unsigned long long start = now_ns();
+	bit_writer_t w;
+	size_t bytes;
+
+	choose_coding(xi, n, &h->order[0], &h->k[0]);
+	choose_coding(xq, n, &h->order[1], &h->k[1]);
+
+	w.out = (unsigned char *)out + sizeof(*h);
+	w.acc = 0;
+	w.fill = 0;
+	stats->escapes += encode_component(&w, xi, n, h->order[0], h->k[0]);
+	stats->escapes += encode_component(&w, xq, n, h->order[1], h->k[1]);
+	flush_bits(&w);
+
+	bytes = (size_t)((char *)w.out - out);
+	h->bytes = htons((unsigned short)bytes);
+	h->samples = htons((unsigned short)n);
+
+	stats->samples += n;
+	stats->bytes += bytes;
+	stats->ns += now_ns() - start;
+
+	return bytes;
+}
@@ -0,0 +1,36 @@
+#ifndef _RSP_TCP_RICE_H
+#define _RSP_TCP_RICE_H
+
+#include <stddef.h>
+
+#include "rsp_tcp_api.h"
+
+/*
+ * Lossless encoder for RSP_TCP_SAMPLE_FORMAT_RICE16.
+ *
+ * Each block of up to RSP_TCP_RICE_BLOCK_SAMPLES is coded on its own: per
+ * component the predictor order with the smallest residual sum is picked,
+ * the Rice parameter follows from the mean residual, and anything that would
+ * need a long unary run is sent raw behind an escape. The wire format is
+ * described with rsp_tcp_rice_header_t.
+ */
+
+// worst case size of a block of n samples, every component escaped
+#define RICE_MAX_BLOCK_BYTES(n) (sizeof(rsp_tcp_rice_header_t) + (n) * 2 * (RSP_TCP_RICE_ESCAPE + 16) / 8)
+
+typedef struct {
+	// input samples and encoded bytes, headers included
+	unsigned long long samples;
+	unsigned long long bytes;
+
+	// components sent raw
+	unsigned long long escapes;
+
+	// time spent encoding
+	unsigned long long ns;
+} rice_stats_t;
+
+// codes n samples (at most RSP_TCP_RICE_BLOCK_SAMPLES) into out, returns the block size
+size_t rice_encode(char *out, const short *xi, const short *xq, unsigned int n, rice_stats_t *stats);
+
+#endif /* _RSP_TCP_RICE_H */
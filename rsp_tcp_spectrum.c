@@ -0,0 +1,183 @@
+/*
+* rsp_tcp - spectrum frames
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#else
+#include <arpa/inet.h>
+#endif
+
+#include "rsp_tcp_spectrum.h"
+
+#define SPECTRUM_PI 3.14159265358979323846
+
+// int16 full scale, a complex tone of this amplitude reads 0 dB
+#define SPECTRUM_FULL_SCALE 32768.0
+
+static double window_value(rsp_tcp_spectrum_window_t window, unsigned int k, unsigned int n)
+{
+	double x = 2.0 * SPECTRUM_PI * k / n;
+
+	// periodic windows, the transform sees the block as one period
+	switch (window) {
+	case RSP_TCP_SPECTRUM_WINDOW_HANN:
+		return 0.5 - 0.5 * cos(x);
+	case RSP_TCP_SPECTRUM_WINDOW_BLACKMAN_HARRIS:
+		return 0.35875 - 0.48829 * cos(x) + 0.14128 * cos(2.0 * x) - 0.01168 * cos(3.0 * x);
+	default:
+		return 1.0;
+	}
+}
+
+int spectrum_init(spectrum_t *s, unsigned int size, rsp_tcp_spectrum_window_t window)
+{
+	double sum = 0.0;
+	unsigned int k;
+
+	spectrum_free(s);
+
+	if (size < RSP_TCP_SPECTRUM_MIN_SIZE || size > RSP_TCP_SPECTRUM_MAX_SIZE || (size & (size - 1)) != 0 ||
+		window > RSP_TCP_SPECTRUM_WINDOW_BLACKMAN_HARRIS) {
+		return -1;
+	}
+
+	if (fft_init(&s->fft, size)) {
+		return -1;
+	}
+	s->window = (float *)malloc(6 * (size_t)size * sizeof(float));
+	if (s->window == NULL) {
+		fft_free(&s->fft);
+		return -1;
+	}
+	s->re = s->window + size;
+	s->im = s->re + size;
+	s->work = s->im + size;
+	s->power = s->work + 2 * size;
+	s->size = size;
+
+	for (k = 0; k < size; k++) {
+		s->window[k] = (float)window_value(window, k, size);
+		sum += s->window[k];
+	}
+	s->offset_db = (float)(-20.0 * log10(SPECTRUM_FULL_SCALE * sum));
+
+	spectrum_set_timing(s, size, 0);
+
+	return 0;
+}
+
+void spectrum_free(spectrum_t *s)
+{
+	if (s->size) {
+		fft_free(&s->fft);
+		free(s->window);
+	}
+	memset(s, 0, sizeof(*s));
+}
+
+void spectrum_set_timing(spectrum_t *s, unsigned int interval, unsigned int average)
+{
+	s->interval = interval;
+	s->average = average;
+	s->elapsed = 0;
+	s->fill = 0;
+	s->transforms = 0;
+	memset(s->power, 0, s->size * sizeof(float));
+}
+
+static void transform(spectrum_t *s)
+{
+	unsigned int k;
+
+	fft_forward(&s->fft, s->re, s->im, s->work);
+	for (k = 0; k < s->size; k++) {
+		s->power[k] += s->re[k] * s->re[k] + s->im[k] * s->im[k];
+	}
+	s->transforms++;
+	s->fill = 0;
+}
+
+unsigned int spectrum_feed(spectrum_t *s, const short *xi, const short *xq, unsigned int n)
+{
+	unsigned int i, k, used = 0;
+
+	while (used < n && !spectrum_due(s)) {
+		if (s->average && s->transforms >= s->average) {
+			// enough blocks for this frame, skip to the end of the interval
+			k = s->interval - s->elapsed;
+			if (k > n - used) {
+				k = n - used;
+			}
+		}
+		else {
+			k = s->size - s->fill;
+			if (k > n - used) {
+				k = n - used;
+			}
+			for (i = 0; i < k; i++) {
+				s->re[s->fill + i] = xi[used + i] * s->window[s->fill + i];
+				s->im[s->fill + i] = xq[used + i] * s->window[s->fill + i];
+			}
+			s->fill += k;
+			if (s->fill == s->size) {
+				transform(s);
+			}
+		}
+		s->elapsed += k;
+		used += k;
+	}
+
+	return used;
+}
+
+int spectrum_due(const spectrum_t *s)
+{
+	return s->transforms && s->elapsed >= s->interval;
+}
+
+size_t spectrum_frame(spectrum_t *s, char *out, unsigned int rate)
+{
+	rsp_tcp_spectrum_header_t *h = (rsp_tcp_spectrum_header_t *)out;
+	unsigned char *bins = (unsigned char *)out + sizeof(rsp_tcp_spectrum_header_t);
+	float offset = s->offset_db - 10.0f * log10f((float)s->transforms);
+	float v;
+	unsigned int k, half = s->size / 2;
+
+	if (out) {
+		memcpy(h->magic, RSP_TCP_SPECTRUM_MAGIC, 4);
+		h->size = htonl(s->size);
+		h->rate = htonl(rate);
+		h->transforms = htonl(s->transforms);
+
+		// the upper half of the transform holds the negative frequencies
+		for (k = 0; k < s->size; k++) {
+			v = 255.5f + (float)RSP_TCP_SPECTRUM_STEPS_PER_DB * (10.0f * log10f(s->power[(k + half) & (s->size - 1)]) + offset);
+			bins[k] = (unsigned char)(v < 0.0f ? 0.0f : v > 255.0f ? 255.0f : v);
+		}
+	}
+
+	// a block that did not fit in the interval goes on into the next frame
+	s->elapsed = s->elapsed - s->interval < s->interval ? s->elapsed - s->interval : 0;
+	s->transforms = 0;
+	memset(s->power, 0, s->size * sizeof(float));
+
+	return SPECTRUM_FRAME_BYTES(s->size);
+}
@@ -0,0 +1,62 @@
+#ifndef _RSP_TCP_SPECTRUM_H
+#define _RSP_TCP_SPECTRUM_H
+
+#include <stddef.h>
+
+#include "rsp_tcp_api.h"
+#include "rsp_tcp_fft.h"
+
+/*
+ * Log-power spectrum for RSP_TCP_COMMAND_SET_SPECTRUM.
+ *
+ * The input is cut into blocks of the FFT size without overlap, each block
+ * is windowed and transformed and its power added to the bins. A frame
+ * covers interval input samples and sums the first average blocks of it,
+ * or all of them for 0; the rest of the interval is not transformed, so a
+ * lower average saves the CPU time. Frames are laid out as described with
+ * rsp_tcp_spectrum_header_t.
+ */
+
+// bytes of a frame of size bins
+#define SPECTRUM_FRAME_BYTES(size) (sizeof(rsp_tcp_spectrum_header_t) + (size))
+
+typedef struct {
+	fft_t fft;
+	unsigned int size;
+
+	// input samples per frame, transforms per frame or 0 for all of them
+	unsigned int interval;
+	unsigned int average;
+
+	// input samples of the frame so far, of the block so far, and blocks transformed
+	unsigned int elapsed;
+	unsigned int fill;
+	unsigned int transforms;
+
+	// dB relative to full scale of a bin power of 1
+	float offset_db;
+
+	// one allocation: window, block, FFT work space and the summed power of each bin
+	float *window;
+	float *re, *im;
+	float *work;
+	float *power;
+} spectrum_t;
+
+// size a power of two from RSP_TCP_SPECTRUM_MIN_SIZE to RSP_TCP_SPECTRUM_MAX_SIZE, returns -1 otherwise
+int spectrum_init(spectrum_t *s, unsigned int size, rsp_tcp_spectrum_window_t window);
+void spectrum_free(spectrum_t *s);
+
+// starts a new frame, an interval shorter than a block gives a frame per block
+void spectrum_set_timing(spectrum_t *s, unsigned int interval, unsigned int average);
+
+// takes up to n samples, stops early when a frame is due, returns the number taken
+unsigned int spectrum_feed(spectrum_t *s, const short *xi, const short *xq, unsigned int n);
+
+// the frame interval is over and there is something to send
+int spectrum_due(const spectrum_t *s);
+
+// writes the frame for a sample rate to out, or drops it for NULL, and starts the next one, returns its size
+size_t spectrum_frame(spectrum_t *s, char *out, unsigned int rate);
+
+#endif /* _RSP_TCP_SPECTRUM_H */
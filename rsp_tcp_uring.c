@@ -0,0 +1,162 @@
+/*
+* rsp_tcp - io_uring transmit path
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifdef HAVE_LIBURING
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <liburing.h>
+
+#include "rsp_tcp_uring.h"
+
+// longest chain submitted at once
+#define TCP_URING_MAX_SQES 64
+
+static struct io_uring ring;
+static unsigned int ring_entries = 0;
+
+// registered slab, requests inside it use IORING_OP_WRITE_FIXED
+static char *fixed_buf = NULL;
+static size_t fixed_len = 0;
+
+int tcp_uring_init(unsigned int entries, void *buf, size_t len)
+{
+	struct iovec reg;
+	int r;
+
+	r = io_uring_queue_init(entries, &ring, 0);
+	if (r < 0) {
+		printf("io_uring not available (%s), using send()\n", strerror(-r));
+		return -1;
+	}
+	ring_entries = entries;
+
+	if (buf != NULL) {
+		reg.iov_base = buf;
+		reg.iov_len = len;
+		r = io_uring_register_buffers(&ring, &reg, 1);
+		if (r < 0) {
+			// usually RLIMIT_MEMLOCK, the whole pool slab is pinned, plain sends still avoid the syscall per block
+			printf("io_uring registration of %lu kB failed (%s), not using fixed buffers (see ulimit -l)\n",
+				(unsigned long)(len / 1024), strerror(-r));
+		}
+		else {
+			fixed_buf = (char *)buf;
+			fixed_len = len;
+		}
+	}
+
+	return 0;
+}
+
+void tcp_uring_exit(void)
+{
+	if (ring_entries == 0) {
+		return;
+	}
+
+	if (fixed_buf != NULL) {
+		io_uring_unregister_buffers(&ring);
+		fixed_buf = NULL;
+		fixed_len = 0;
+	}
+
+	io_uring_queue_exit(&ring);
+	ring_entries = 0;
+}
+
+static int is_fixed(struct iovec *iov)
+{
+	char *p = (char *)iov->iov_base;
+
+	return fixed_buf != NULL && p >= fixed_buf && p + iov->iov_len <= fixed_buf + fixed_len;
+}
+
+long tcp_uring_send(int sock, struct iovec *iov, int count)
+{
+	struct io_uring_sqe *sqe;
+	struct io_uring_cqe *cqe;
+	int res[TCP_URING_MAX_SQES];
+	long sent = 0;
+	int i, r;
+
+	if (count > TCP_URING_MAX_SQES) {
+		count = TCP_URING_MAX_SQES;
+	}
+
+	for (i = 0; i < count; i++) {
+		sqe = io_uring_get_sqe(&ring);
+		if (sqe == NULL) {
+			break;
+		}
+
+		// a short write fails the request, which cancels everything linked behind it,
+		// a send only counts as short with MSG_WAITALL, without it the next one would
+		// go out after a hole in the stream
+		if (is_fixed(&iov[i])) {
+			io_uring_prep_write_fixed(sqe, sock, iov[i].iov_base, (unsigned int)iov[i].iov_len, 0, 0);
+		}
+		else {
+			io_uring_prep_send(sqe, sock, iov[i].iov_base, iov[i].iov_len, MSG_WAITALL);
+		}
+		io_uring_sqe_set_data(sqe, (void *)(size_t)i);
+
+		if (i + 1 < count) {
+			sqe->flags |= IOSQE_IO_LINK;
+		}
+	}
+	count = i;
+
+	r = io_uring_submit_and_wait(&ring, count);
+	if (r < 0) {
+		errno = -r;
+		return -1;
+	}
+
+	// every request of the chain completes, cancelled ones with -ECANCELED
+	for (i = 0; i < count; i++) {
+		r = io_uring_wait_cqe(&ring, &cqe);
+		if (r < 0) {
+			errno = -r;
+			return -1;
+		}
+		res[(size_t)io_uring_cqe_get_data(cqe)] = cqe->res;
+		io_uring_cqe_seen(&ring, cqe);
+	}
+
+	// in order up to the first failed or short request, nothing behind it went out
+	for (i = 0; i < count; i++) {
+		if (res[i] < 0) {
+			if (i == 0) {
+				errno = -res[i];
+				return -1;
+			}
+			break;
+		}
+
+		sent += res[i];
+		if ((size_t)res[i] < iov[i].iov_len) {
+			break;
+		}
+	}
+
+	return sent;
+}
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef _RSP_TCP_URING_H
+#define _RSP_TCP_URING_H
+
+#include <stddef.h>
+
+#ifdef HAVE_LIBURING
+#include <sys/uio.h>
+
+/*
+ * io_uring transmit path for the data socket (Linux, liburing).
+ *
+ * A batch of queued blocks is submitted as a chain of linked send requests
+ * and reaped with the same io_uring_enter() call. The sends use MSG_WAITALL,
+ * so a short one fails and cancels the rest of the chain. When the block pool slab
+ * can be registered with the ring the requests use the fixed buffer, so the
+ * kernel does not pin and unpin the pages on every send.
+ */
+
+// set up the ring, buf/len is registered as fixed buffer when not NULL
+int tcp_uring_init(unsigned int entries, void *buf, size_t len);
+void tcp_uring_exit(void);
+
+// same contract as sendmsg(): bytes sent in order, or -1 with errno set
+long tcp_uring_send(int sock, struct iovec *iov, int count);
+
+#endif
+
+#endif /* _RSP_TCP_URING_H */